@@ -12,10 +12,33 @@
 
 int main(int argc, char **argv) {
     NOB_GO_REBUILD_URSELF(argc, argv);
+    const char *program_name = shift(argv, argc);
+
     Cmd cmd = {0};
-    cmd_append(&cmd, CC, CFLAGS, "-o", "canal", "src/main.c", "src/str.c");
+    cmd_append(&cmd, CC, CFLAGS, "-o", "canal", "src/main.c", "src/str.c", "src/cache.c", "src/scan.c", "src/index.c", "src/regex.c", "src/aho.c");
     if (!cmd_run_sync_and_reset(&cmd)) {
         return 1;
     }
+    if (argc == 0) return 0;
+
+    // both include src/main.c, the tests include src/scan.c as well to get at every kernel
+    const char *command = shift(argv, argc);
+    if (strcmp(command, "test") == 0) {
+        cmd_append(&cmd, CC, CFLAGS, "-o", "tests/kernels", "tests/kernels.c", "src/str.c", "src/cache.c", "src/index.c", "src/regex.c", "src/aho.c");
+        if (!cmd_run_sync_and_reset(&cmd)) return 1;
+        cmd_append(&cmd, "./tests/kernels");
+        if (!cmd_run_sync_and_reset(&cmd)) return 1;
+        cmd_append(&cmd, "./canal", "--no-cache", "tests/checks");
+        if (!cmd_run_sync_and_reset(&cmd)) return 1;
+    } else if (strcmp(command, "bench") == 0) {
+        cmd_append(&cmd, CC, CFLAGS, "-o", "tests/bench", "tests/bench.c", "src/str.c", "src/cache.c", "src/scan.c", "src/index.c", "src/regex.c", "src/aho.c");
+        if (!cmd_run_sync_and_reset(&cmd)) return 1;
+        cmd_append(&cmd, "./tests/bench");
+        if (!cmd_run_sync_and_reset(&cmd)) return 1;
+    } else {
+        nob_log(ERROR, "Usage: %s [test|bench]", program_name);
+        nob_log(ERROR, "unknown command '%s'", command);
+        return 1;
+    }
     return 0;
 }
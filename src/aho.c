@@ -0,0 +1,65 @@
+#include <assert.h>
+
+#include "./aho.h"
+
+#define AHO_NONE UINT32_MAX
+
+void aho_build(Arena *arena, Aho *aho, const char *const *patterns, const uint32_t *counts, size_t pattern_count) {
+    assert(pattern_count <= AHO_MAX_PATTERNS);
+
+    size_t capacity = 1;
+    for (size_t i = 0; i < pattern_count; ++i) capacity += counts[i];
+
+    aho->next = arena_alloc(arena, capacity*256*sizeof(*aho->next));
+    aho->hits = arena_alloc(arena, capacity*sizeof(*aho->hits));
+    aho->depths = arena_alloc(arena, capacity*sizeof(*aho->depths));
+    uint32_t *fail = arena_alloc(arena, capacity*sizeof(*fail));
+    uint32_t *queue = arena_alloc(arena, capacity*sizeof(*queue));
+    memset(aho->next, 0xFF, capacity*256*sizeof(*aho->next));
+
+    aho->state_count = 1;
+    aho->hits[0] = 0;
+    aho->depths[0] = 0;
+
+    for (size_t i = 0; i < pattern_count; ++i) {
+        uint32_t state = 0;
+        for (size_t j = 0; j < counts[i]; ++j) {
+            uint32_t *next = &aho->next[state*256 + (uint8_t) patterns[i][j]];
+            if (*next == AHO_NONE) {
+                *next = aho->state_count++;
+                aho->hits[*next] = 0;
+                aho->depths[*next] = aho->depths[state] + 1;
+            }
+            state = *next;
+        }
+        aho->hits[state] |= 1ULL << i;
+    }
+
+    // breadth first, so the failure target of a state is always done before the state itself
+    size_t head = 0;
+    size_t tail = 0;
+    for (size_t ch = 0; ch < 256; ++ch) {
+        uint32_t *next = &aho->next[ch];
+        if (*next == AHO_NONE) {
+            *next = 0;
+        } else {
+            fail[*next] = 0;
+            queue[tail++] = *next;
+        }
+    }
+
+    while (head < tail) {
+        uint32_t state = queue[head++];
+        aho->hits[state] |= aho->hits[fail[state]];
+        for (size_t ch = 0; ch < 256; ++ch) {
+            uint32_t *next = &aho->next[state*256 + ch];
+            uint32_t fallback = aho->next[fail[state]*256 + ch];
+            if (*next == AHO_NONE) {
+                *next = fallback;
+            } else {
+                fail[*next] = fallback;
+                queue[tail++] = *next;
+            }
+        }
+    }
+}
@@ -0,0 +1,20 @@
+#ifndef AHO_H_
+#define AHO_H_
+
+#include <stdint.h>
+
+#include "./str.h"
+
+#define AHO_MAX_PATTERNS 64
+
+// the transitions are a dense table with the failure links folded in: `next[state*256 + byte]`
+typedef struct {
+    uint32_t *next;
+    uint64_t *hits;
+    uint32_t *depths;
+    uint32_t state_count;
+} Aho;
+
+void aho_build(Arena *arena, Aho *aho, const char *const *patterns, const uint32_t *counts, size_t pattern_count);
+
+#endif // AHO_H_
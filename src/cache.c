@@ -0,0 +1,235 @@
+#ifndef _WIN32
+#    define _POSIX_C_SOURCE 200809L
+#    include <unistd.h>
+#    include <fcntl.h>
+#    include <sys/stat.h>
+#endif
+
+#include "./cache.h"
+
+#define NOB_STRIP_PREFIX
+#include "./nob.h"
+
+// an entry is the magic, the exit status in one byte, the sizes of stdout and stderr and then both outputs
+#define CACHE_MAGIC "CNL2"
+#define CACHE_HEADER_SIZE (4 + 1 + 2*sizeof(uint64_t))
+
+#ifndef _WIN32
+// finds the executable the same way execvp does, so the key changes when the compiler is rebuilt
+static bool cache_find_executable(const char *name, struct stat *statbuf) {
+    if (strchr(name, '/') != NULL) {
+        return stat(name, statbuf) == 0;
+    }
+
+    const char *path = getenv("PATH");
+    if (path == NULL) return false;
+
+    bool found = false;
+    size_t temp_checkpoint = nob_temp_save();
+    String_View dirs = sv_from_cstr(path);
+    while (dirs.count > 0 && !found) {
+        String_View dir = sv_chop_by_delim(&dirs, ':');
+        const char *candidate = nob_temp_sprintf(SV_Fmt"/%s", SV_Arg(dir), name);
+        found = access(candidate, X_OK) == 0 && stat(candidate, statbuf) == 0;
+    }
+    nob_temp_rewind(temp_checkpoint);
+    return found;
+}
+
+// the executable is identified by its stat stamp, hashing a whole compiler for every command would cost too much
+bool cache_key(const char **argv, size_t argc, uint64_t source_hash, uint64_t *key) {
+    if (argc == 0) return false;
+
+    struct stat statbuf;
+    if (!cache_find_executable(argv[0], &statbuf)) return false;
+
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd)) == NULL) return false;
+
+    uint64_t hash = STR_HASH_SEED;
+    hash = str_hash(hash, &source_hash, sizeof(source_hash));
+    for (size_t i = 0; i < argc; ++i) {
+        hash = str_hash(hash, argv[i], strlen(argv[i]) + 1);
+    }
+
+    uint64_t stamp[] = {
+        statbuf.st_dev,
+        statbuf.st_ino,
+        statbuf.st_size,
+        statbuf.st_mtim.tv_sec,
+        statbuf.st_mtim.tv_nsec,
+    };
+    hash = str_hash(hash, stamp, sizeof(stamp));
+    hash = str_hash(hash, cwd, strlen(cwd));
+
+    *key = hash;
+    return true;
+}
+
+bool cache_load(Arena *arena, const char *dir, uint64_t key, Cache_Entry *entry) {
+    bool result = true;
+
+    const char *path = arena_sprintf(arena, "%s/%016llx", dir, (unsigned long long) key);
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) return false;
+
+    String data = {0};
+    if (fseek(file, 0L, SEEK_END) != 0) return_defer(false);
+    long file_size = ftell(file);
+    if (file_size < (long) CACHE_HEADER_SIZE) return_defer(false);
+    rewind(file);
+
+    str_ensure_capacity(arena, &data, file_size);
+    if (fread(data.items, sizeof(char), file_size, file) != (size_t) file_size) return_defer(false);
+    data.count = file_size;
+
+    if (memcmp(data.items, CACHE_MAGIC, 4) != 0) return_defer(false);
+    uint64_t out_count;
+    uint64_t err_count;
+    memcpy(&out_count, data.items + 5, sizeof(out_count));
+    memcpy(&err_count, data.items + 5 + sizeof(out_count), sizeof(err_count));
+    if (CACHE_HEADER_SIZE + out_count + err_count != data.count) return_defer(false);
+
+    entry->exit_status = (uint8_t) data.items[4];
+    entry->out = (String) {
+        .items = data.items + CACHE_HEADER_SIZE,
+        .count = out_count,
+        .capacity = out_count,
+    };
+    entry->err = (String) {
+        .items = data.items + CACHE_HEADER_SIZE + out_count,
+        .count = err_count,
+        .capacity = err_count,
+    };
+
+    // the modification time doubles as the last use for the eviction
+    utimensat(AT_FDCWD, path, NULL, 0);
+
+defer:
+    fclose(file);
+    return result;
+}
+
+// written under a temporary name and renamed, so concurrent canals see either the old file or the whole new one
+bool cache_write_file(Arena *arena, const char *path, const char *data, size_t count) {
+    const char *temp_path = arena_sprintf(arena, "%s.%d.tmp", path, (int) getpid());
+    if (!nob_write_entire_file(temp_path, data, count)) return false;
+    if (!nob_rename(temp_path, path)) {
+        nob_delete_file(temp_path);
+        return false;
+    }
+    return true;
+}
+
+void cache_store(Arena *arena, const char *dir, uint64_t key, int exit_status, String *out, String *err) {
+    if (!nob_mkdir_if_not_exists(dir)) return;
+
+    String data = {0};
+    uint64_t out_count = out->count;
+    uint64_t err_count = err->count;
+    str_ensure_capacity(arena, &data, CACHE_HEADER_SIZE + out_count + err_count);
+    arena_da_append_many(arena, &data, CACHE_MAGIC, 4);
+    arena_da_append(arena, &data, (char) exit_status);
+    arena_da_append_many(arena, &data, (char*) &out_count, sizeof(out_count));
+    arena_da_append_many(arena, &data, (char*) &err_count, sizeof(err_count));
+    arena_da_append_many(arena, &data, out->items, out->count);
+    arena_da_append_many(arena, &data, err->items, err->count);
+
+    const char *path = arena_sprintf(arena, "%s/%016llx", dir, (unsigned long long) key);
+    cache_write_file(arena, path, data.items, data.count);
+}
+
+typedef struct {
+    const char *path;
+    size_t size;
+    struct timespec mtime;
+} Cache_File;
+
+typedef struct {
+    Cache_File *items;
+    size_t count;
+    size_t capacity;
+} Cache_Files;
+
+static int cache_compare_files(const void *a, const void *b) {
+    const Cache_File *fa = a;
+    const Cache_File *fb = b;
+    if (fa->mtime.tv_sec != fb->mtime.tv_sec) return fa->mtime.tv_sec < fb->mtime.tv_sec ? -1 : 1;
+    if (fa->mtime.tv_nsec != fb->mtime.tv_nsec) return fa->mtime.tv_nsec < fb->mtime.tv_nsec ? -1 : 1;
+    return 0;
+}
+
+void cache_evict(const char *dir, size_t limit) {
+    size_t temp_checkpoint = nob_temp_save();
+    Nob_File_Paths children = {0};
+    Cache_Files files = {0};
+    if (!nob_read_entire_dir(dir, &children)) goto defer;
+
+    size_t total = 0;
+    for (size_t i = 0; i < children.count; ++i) {
+        if (children.items[i][0] == '.') continue;
+
+        const char *path = nob_temp_sprintf("%s/%s", dir, children.items[i]);
+        struct stat statbuf;
+        if (stat(path, &statbuf) < 0 || !S_ISREG(statbuf.st_mode)) continue;
+
+        nob_da_append(&files, ((Cache_File) {
+            .path = path,
+            .size = statbuf.st_size,
+            .mtime = statbuf.st_mtim,
+        }));
+        total += statbuf.st_size;
+    }
+    if (total <= limit) goto defer;
+
+    qsort(files.items, files.count, sizeof(*files.items), cache_compare_files);
+    for (size_t i = 0; i < files.count && total > limit; ++i) {
+        if (nob_delete_file(files.items[i].path)) {
+            total -= files.items[i].size;
+        }
+    }
+
+defer:
+    nob_da_free(files);
+    nob_da_free(children);
+    nob_temp_rewind(temp_checkpoint);
+}
+#else
+bool cache_write_file(Arena *arena, const char *path, const char *data, size_t count) {
+    NOB_UNUSED(arena);
+    NOB_UNUSED(path);
+    NOB_UNUSED(data);
+    NOB_UNUSED(count);
+    return false;
+}
+
+bool cache_key(const char **argv, size_t argc, uint64_t source_hash, uint64_t *key) {
+    NOB_UNUSED(argv);
+    NOB_UNUSED(argc);
+    NOB_UNUSED(source_hash);
+    NOB_UNUSED(key);
+    return false;
+}
+
+bool cache_load(Arena *arena, const char *dir, uint64_t key, Cache_Entry *entry) {
+    NOB_UNUSED(arena);
+    NOB_UNUSED(dir);
+    NOB_UNUSED(key);
+    NOB_UNUSED(entry);
+    return false;
+}
+
+void cache_store(Arena *arena, const char *dir, uint64_t key, int exit_status, String *out, String *err) {
+    NOB_UNUSED(arena);
+    NOB_UNUSED(dir);
+    NOB_UNUSED(key);
+    NOB_UNUSED(exit_status);
+    NOB_UNUSED(out);
+    NOB_UNUSED(err);
+}
+
+void cache_evict(const char *dir, size_t limit) {
+    NOB_UNUSED(dir);
+    NOB_UNUSED(limit);
+}
+#endif // _WIN32
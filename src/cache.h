@@ -0,0 +1,21 @@
+#ifndef CACHE_H_
+#define CACHE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "./str.h"
+
+typedef struct {
+    int exit_status;
+    String out;
+    String err;
+} Cache_Entry;
+
+bool cache_key(const char **argv, size_t argc, uint64_t source_hash, uint64_t *key);
+bool cache_load(Arena *arena, const char *dir, uint64_t key, Cache_Entry *entry);
+bool cache_write_file(Arena *arena, const char *path, const char *data, size_t count);
+void cache_store(Arena *arena, const char *dir, uint64_t key, int exit_status, String *out, String *err);
+void cache_evict(const char *dir, size_t limit);
+
+#endif // CACHE_H_
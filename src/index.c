@@ -0,0 +1,171 @@
+#ifndef _WIN32
+#    define _POSIX_C_SOURCE 200809L
+#    include <sys/stat.h>
+#endif
+
+#include "./index.h"
+#include "./cache.h"
+
+#define NOB_STRIP_PREFIX
+#include "./nob.h"
+
+#define INDEX_MAGIC "CNLI"
+#define INDEX_VERSION 2
+
+bool index_stamp_eq(Index_Stamp *a, Index_Stamp *b) {
+    return a->dev == b->dev
+        && a->ino == b->ino
+        && a->size == b->size
+        && a->mtime_sec == b->mtime_sec
+        && a->mtime_nsec == b->mtime_nsec;
+}
+
+static bool index_read(String_View *data, void *dst, size_t size) {
+    if (data->count < size) return false;
+    memcpy(dst, data->data, size);
+    data->data += size;
+    data->count -= size;
+    return true;
+}
+
+// a broken or outdated index is no error, everything simply gets parsed again
+bool index_load(Arena *arena, const char *filepath, Index *index) {
+    bool result = true;
+
+    FILE *file = fopen(filepath, "rb");
+    if (file == NULL) return false;
+
+    String buffer = {0};
+    if (fseek(file, 0L, SEEK_END) != 0) return_defer(false);
+    long file_size = ftell(file);
+    if (file_size < 0) return_defer(false);
+    rewind(file);
+
+    str_ensure_capacity(arena, &buffer, file_size);
+    if (fread(buffer.items, sizeof(char), file_size, file) != (size_t) file_size) return_defer(false);
+    buffer.count = file_size;
+
+    String_View data = sv_from_parts(buffer.items, buffer.count);
+    char magic[4];
+    uint32_t version;
+    uint64_t entry_count;
+    if (!index_read(&data, magic, sizeof(magic)) || memcmp(magic, INDEX_MAGIC, sizeof(magic)) != 0) return_defer(false);
+    if (!index_read(&data, &version, sizeof(version)) || version != INDEX_VERSION) return_defer(false);
+    if (!index_read(&data, &entry_count, sizeof(entry_count))) return_defer(false);
+
+    for (uint64_t i = 0; i < entry_count; ++i) {
+        Index_Entry entry = {0};
+
+        uint32_t path_count;
+        if (!index_read(&data, &path_count, sizeof(path_count)) || data.count < path_count) return_defer(false);
+        char *path = arena_alloc(arena, path_count + 1);
+        index_read(&data, path, path_count);
+        path[path_count] = '\0';
+        entry.path = path;
+
+        uint32_t directive_count;
+        if (!index_read(&data, &entry.stamp, sizeof(entry.stamp))) return_defer(false);
+        if (!index_read(&data, &entry.hash, sizeof(entry.hash))) return_defer(false);
+        if (!index_read(&data, &directive_count, sizeof(directive_count))) return_defer(false);
+
+        entry.directive_count = directive_count;
+        entry.directives = arena_alloc(arena, directive_count*sizeof(*entry.directives));
+        for (uint32_t j = 0; j < directive_count; ++j) {
+            Index_Directive *directive = &entry.directives[j];
+            if (!index_read(&data, &directive->action, sizeof(directive->action))) return_defer(false);
+            if (!index_read(&data, &directive->offset, sizeof(directive->offset))) return_defer(false);
+            if (!index_read(&data, &directive->count, sizeof(directive->count))) return_defer(false);
+            if (!index_read(&data, &directive->timeout_ms, sizeof(directive->timeout_ms))) return_defer(false);
+            if (!index_read(&data, &directive->stream, sizeof(directive->stream))) return_defer(false);
+            if (!index_read(&data, &directive->exit_status, sizeof(directive->exit_status))) return_defer(false);
+        }
+
+        arena_da_append(arena, index, entry);
+    }
+
+defer:
+    if (!result) index->count = 0;
+    fclose(file);
+    return result;
+}
+
+Index_Entry *index_find(Index *index, const char *path) {
+    size_t lo = 0;
+    size_t hi = index->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo)/2;
+        int cmp = strcmp(index->items[mid].path, path);
+        if (cmp == 0) return &index->items[mid];
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return NULL;
+}
+
+#ifndef _WIN32
+static void index_write(Arena *arena, String *data, const void *src, size_t size) {
+    arena_da_append_many(arena, data, (const char*) src, size);
+}
+
+bool index_save(Arena *arena, const char *filepath, Index *index) {
+    String data = {0};
+    uint32_t version = INDEX_VERSION;
+    uint64_t entry_count = index->count;
+    index_write(arena, &data, INDEX_MAGIC, 4);
+    index_write(arena, &data, &version, sizeof(version));
+    index_write(arena, &data, &entry_count, sizeof(entry_count));
+
+    for (size_t i = 0; i < index->count; ++i) {
+        Index_Entry *entry = &index->items[i];
+        uint32_t path_count = strlen(entry->path);
+        uint32_t directive_count = entry->directive_count;
+        index_write(arena, &data, &path_count, sizeof(path_count));
+        index_write(arena, &data, entry->path, path_count);
+        index_write(arena, &data, &entry->stamp, sizeof(entry->stamp));
+        index_write(arena, &data, &entry->hash, sizeof(entry->hash));
+        index_write(arena, &data, &directive_count, sizeof(directive_count));
+
+        for (size_t j = 0; j < entry->directive_count; ++j) {
+            Index_Directive *directive = &entry->directives[j];
+            index_write(arena, &data, &directive->action, sizeof(directive->action));
+            index_write(arena, &data, &directive->offset, sizeof(directive->offset));
+            index_write(arena, &data, &directive->count, sizeof(directive->count));
+            index_write(arena, &data, &directive->timeout_ms, sizeof(directive->timeout_ms));
+            index_write(arena, &data, &directive->stream, sizeof(directive->stream));
+            index_write(arena, &data, &directive->exit_status, sizeof(directive->exit_status));
+        }
+    }
+
+    return cache_write_file(arena, filepath, data.items, data.count);
+}
+
+bool index_stamp(const char *path, Index_Stamp *stamp) {
+    struct stat statbuf;
+    if (stat(path, &statbuf) < 0 || !S_ISREG(statbuf.st_mode)) return false;
+
+    *stamp = (Index_Stamp) {
+        .dev = statbuf.st_dev,
+        .ino = statbuf.st_ino,
+        .size = statbuf.st_size,
+        .mtime_sec = statbuf.st_mtim.tv_sec,
+        .mtime_nsec = statbuf.st_mtim.tv_nsec,
+    };
+    return true;
+}
+#else
+bool index_save(Arena *arena, const char *filepath, Index *index) {
+    NOB_UNUSED(arena);
+    NOB_UNUSED(filepath);
+    NOB_UNUSED(index);
+    return false;
+}
+
+bool index_stamp(const char *path, Index_Stamp *stamp) {
+    NOB_UNUSED(path);
+    NOB_UNUSED(stamp);
+    return false;
+}
+#endif // _WIN32
@@ -0,0 +1,47 @@
+#ifndef INDEX_H_
+#define INDEX_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "./str.h"
+
+typedef struct {
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+} Index_Stamp;
+
+typedef struct {
+    uint32_t action;
+    uint32_t offset;
+    uint32_t count;
+    uint64_t timeout_ms;
+    uint32_t stream;
+    int32_t exit_status;
+} Index_Directive;
+
+typedef struct {
+    const char *path;
+    Index_Stamp stamp;
+    uint64_t hash;
+    Index_Directive *directives;
+    size_t directive_count;
+} Index_Entry;
+
+// the entries are sorted by path
+typedef struct {
+    Index_Entry *items;
+    size_t count;
+    size_t capacity;
+} Index;
+
+bool index_stamp(const char *path, Index_Stamp *stamp);
+bool index_stamp_eq(Index_Stamp *a, Index_Stamp *b);
+bool index_load(Arena *arena, const char *filepath, Index *index);
+bool index_save(Arena *arena, const char *filepath, Index *index);
+Index_Entry *index_find(Index *index, const char *path);
+
+#endif // INDEX_H_
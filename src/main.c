@@ -1,6 +1,20 @@
 #ifndef _WIN32
+#    ifdef __linux__
+#        define _GNU_SOURCE
+#    endif
 #    define _POSIX_C_SOURCE 200809L
 #    include <unistd.h>
+#    include <fcntl.h>
+#    include <poll.h>
+#    include <sys/wait.h>
+#    include <sys/stat.h>
+#    include <sys/mman.h>
+#    include <signal.h>
+#    include <time.h>
+#    ifdef __linux__
+#        include <sys/syscall.h>
+#        include <sys/epoll.h>
+#    endif
 #else
 #    define WIN32_LEAN_AND_MEAN
 #    include <windows.h>
@@ -20,6 +34,12 @@
 #define NOB_IMPLEMENTATION
 #include "./nob.h"
 
+#include "./cache.h"
+#include "./scan.h"
+#include "./index.h"
+#include "./regex.h"
+#include "./aho.h"
+
 typedef int Errno;
 
 // NOTE(nic): your string will be overwritten
@@ -35,8 +55,8 @@ Errno canal_read_entire_file(Arena *arena, String *str, const char *filepath) {
     rewind(file);
 
     str_ensure_capacity(arena, str, file_size);
-    fread(str->items, file_size, sizeof(char), file);
-    str->count = file_size;
+    str->count = fread(str->items, sizeof(char), file_size, file);
+    if (ferror(file)) return_defer(errno);
 
 defer:
     if (file != NULL) fclose(file);
@@ -48,13 +68,113 @@ typedef enum {
     CANAL_ACTION_PLUS,
     CANAL_ACTION_BANG,
     CANAL_ACTION_RUN,
+    // after RUN, so the actions in suite indexes written before it keep their numbers
+    CANAL_ACTION_AMPERSAND,
     CANAL_ACTION_COUNT,
 } Canal_Action;
 
+typedef enum {
+    CANAL_STREAM_STDOUT,
+    CANAL_STREAM_STDERR,
+    CANAL_STREAM_COUNT,
+} Canal_Stream;
+
+static_assert(CANAL_STREAM_COUNT == 2, "Number of streams change, update code here!");
+const char *canal_stream_names[] = {
+    [CANAL_STREAM_STDOUT] = "stdout",
+    [CANAL_STREAM_STDERR] = "stderr",
+};
+
+typedef enum {
+    CANAL_PART_LITERAL,
+    CANAL_PART_PATTERN,
+    CANAL_PART_USE,
+} Canal_Part_Kind;
+
+#define CANAL_NO_SLOT UINT32_MAX
+
+typedef struct {
+    Canal_Part_Kind kind;
+    String_View text;
+    Regex *regex;
+    uint32_t variable;
+    // a use of a capture of the same directive refers to its slot, CANAL_NO_SLOT means an earlier directive bound it
+    uint32_t slot;
+} Canal_Part;
+
+typedef struct {
+    const char *data;
+    uint32_t count;
+    char first;
+    Regex *regex;
+    Canal_Part *parts;
+    uint32_t part_count;
+} Canal_Token;
+
+#define CANAL_NO_MEMBER UINT32_MAX
+
+typedef struct Canal_Directive Canal_Directive;
+
+typedef struct {
+    Aho aho;
+    Canal_Directive *members[AHO_MAX_PATTERNS];
+    size_t member_count;
+} Canal_Automaton;
+
 typedef struct {
+    uint32_t member;
+    size_t first;
+    size_t count;
+    uint32_t chain;
+} Canal_Group_Entry;
+
+typedef struct {
+    uint64_t hash;
+    size_t length;
+    uint32_t entry;
+    uint32_t longer;
+} Canal_Group_Key;
+
+// a run of `&` directives, whose lines can come in any order. The members made of plain words are keyed by the
+// hashes of their words, the ones that start with a plain word are bucketed by it and the rest is tried on every line
+typedef struct {
+    Canal_Directive *members;
+    size_t first;
+    size_t count;
+
+    Canal_Group_Entry *entries;
+    size_t entry_count;
+    uint32_t *order;
+    Canal_Group_Key *keys;
+    size_t key_capacity;
+    uint32_t *link_entries;
+    uint32_t *link_next;
+    size_t max_length;
+
+    uint64_t *hashes;
+    uint32_t *buckets;
+    uint32_t *chain;
+    size_t capacity;
+
+    uint32_t *wildcards;
+    size_t wildcard_count;
+} Canal_Group;
+
+struct Canal_Directive {
     Canal_Action action;
     String_View arguments;
-} Canal_Directive;
+    uint64_t timeout_ms;
+    int exit_status;
+    Canal_Stream stream;
+    Canal_Token *tokens;
+    size_t token_count;
+    String_View words;
+    Canal_Automaton *automaton;
+    uint32_t *binds;
+    String_View *bound;
+    size_t bind_count;
+    Canal_Group *group;
+};
 
 typedef struct {
     Canal_Directive *items;
@@ -62,274 +182,2488 @@ typedef struct {
     size_t capacity;
 } Canal_Directives;
 
+typedef struct {
+    String_View pattern;
+    Regex *regex;
+} Canal_Regex;
+
+typedef struct {
+    Canal_Regex *items;
+    size_t count;
+    size_t capacity;
+} Canal_Regexes;
+
 typedef struct {
     Canal_Directives r_directives;
-    Canal_Directives directives;
+    Canal_Directives directives[CANAL_STREAM_COUNT];
+    uint64_t source_hash;
+    Canal_Regexes regexes;
+    size_t variable_count;
 } Canal_Check;
 
 int not_isspace(int ch) {
     return !isspace(ch);
 }
 
-void canal_collect_directives(Arena *arena, Canal_Check *check, String_View source) {
+// parses durations like `500ms`, `10s` or `2m`, a plain number is in seconds
+bool canal_parse_duration(String_View sv, uint64_t *ms) {
+    sv = sv_trim(sv);
+
+    uint64_t value = 0;
+    size_t i = 0;
+    while (i < sv.count && isdigit((unsigned char) sv.data[i])) {
+        value = value*10 + (sv.data[i] - '0');
+        i += 1;
+    }
+    if (i == 0) return false;
+
+    String_View unit = sv_from_parts(sv.data + i, sv.count - i);
+    if (unit.count == 0 || sv_eq(unit, sv_from_cstr("s"))) {
+        *ms = value*1000;
+    } else if (sv_eq(unit, sv_from_cstr("ms"))) {
+        *ms = value;
+    } else if (sv_eq(unit, sv_from_cstr("m"))) {
+        *ms = value*60*1000;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool canal_parse_exit_status(String_View sv, int *exit_status) {
+    sv = sv_trim(sv);
+    if (sv.count == 0 || sv.count > 3) return false;
+
+    int value = 0;
+    for (size_t i = 0; i < sv.count; ++i) {
+        if (!isdigit((unsigned char) sv.data[i])) return false;
+        value = value*10 + (sv.data[i] - '0');
+    }
+    if (value > 255) return false;
+    *exit_status = value;
+    return true;
+}
+
+bool canal_collect_directives(Arena *arena, Canal_Check *check, String_View source, String *error) {
     // TODO(nic): make the prefix customizable
     String_View prefix = sv_from_cstr("//");
+    uint64_t timeout_ms = 0;
+    int exit_status = 0;
     while (source.count > 0) {
+        size_t skip = scan_line_prefix(source.data, source.count, 0, prefix.data, prefix.count);
+        sv_chop_left(&source, skip);
+        if (source.count == 0) break;
+
         String_View line = sv_chop_by_delim(&source, '\n');
-        if (sv_starts_with(line, prefix)) {
-            sv_chop_left(&line, prefix.count);
-            line = sv_trim(line);
-
-            String_View action = sv_chop_by_predicate(&line, not_isspace);
-            String_View arguments = line;
-
-            Canal_Directive directive = {0};
-            directive.arguments = arguments;
-
-            static_assert(CANAL_ACTION_COUNT == 4, "Number of actions change, update code here!");
-            if (sv_eq(action, sv_from_cstr("*"))) {
-                directive.action = CANAL_ACTION_STAR;
-            } else if (sv_eq(action, sv_from_cstr("+"))) {
-                directive.action = CANAL_ACTION_PLUS;
-            } else if (sv_eq(action, sv_from_cstr("!"))) {
-                directive.action = CANAL_ACTION_BANG;
-            } else if (sv_eq(action, sv_from_cstr("R"))) {
-                directive.action = CANAL_ACTION_RUN;
-            } else {
-                continue;
+        sv_chop_left(&line, prefix.count);
+        line = sv_trim(line);
+
+        String_View action = sv_chop_by_predicate(&line, not_isspace);
+        String_View arguments = line;
+
+        if (sv_eq(action, sv_from_cstr("TIMEOUT"))) {
+            if (!canal_parse_duration(arguments, &timeout_ms)) {
+                str_append_fmt(arena, error, "invalid timeout '"SV_Fmt"'\n", SV_Arg(arguments));
+                return false;
             }
+            continue;
+        }
+        if (sv_eq(action, sv_from_cstr("EXIT"))) {
+            if (!canal_parse_exit_status(arguments, &exit_status)) {
+                str_append_fmt(arena, error, "invalid exit status '"SV_Fmt"'\n", SV_Arg(arguments));
+                return false;
+            }
+            continue;
+        }
 
-            if (directive.action == CANAL_ACTION_RUN) {
-                arena_da_append(arena, &check->r_directives, directive);
-            } else {
-                arena_da_append(arena, &check->directives, directive);
+        Canal_Directive directive = {0};
+        static_assert(CANAL_STREAM_COUNT == 2, "Number of streams change, update code here!");
+        if (sv_eq(action, sv_from_cstr("STDOUT")) || sv_eq(action, sv_from_cstr("STDERR"))) {
+            directive.stream = sv_eq(action, sv_from_cstr("STDERR")) ? CANAL_STREAM_STDERR : CANAL_STREAM_STDOUT;
+            line = sv_trim_left(line);
+            action = sv_chop_by_predicate(&line, not_isspace);
+            arguments = line;
+        }
+        directive.arguments = arguments;
+        directive.timeout_ms = timeout_ms;
+        directive.exit_status = exit_status;
+
+        static_assert(CANAL_ACTION_COUNT == 5, "Number of actions change, update code here!");
+        if (sv_eq(action, sv_from_cstr("*"))) {
+            directive.action = CANAL_ACTION_STAR;
+        } else if (sv_eq(action, sv_from_cstr("+"))) {
+            directive.action = CANAL_ACTION_PLUS;
+        } else if (sv_eq(action, sv_from_cstr("!"))) {
+            directive.action = CANAL_ACTION_BANG;
+        } else if (sv_eq(action, sv_from_cstr("R"))) {
+            directive.action = CANAL_ACTION_RUN;
+        } else if (sv_eq(action, sv_from_cstr("&"))) {
+            directive.action = CANAL_ACTION_AMPERSAND;
+        } else {
+            continue;
+        }
+
+        if (directive.action == CANAL_ACTION_RUN) {
+            arena_da_append(arena, &check->r_directives, directive);
+        } else {
+            arena_da_append(arena, &check->directives[directive.stream], directive);
+        }
+    }
+    return true;
+}
+
+void canal_check_to_index(Arena *arena, Canal_Check *check, String_View source, Index_Entry *entry) {
+    static_assert(CANAL_STREAM_COUNT == 2, "Number of streams change, update code here!");
+    Canal_Directives *lists[] = { &check->r_directives, &check->directives[CANAL_STREAM_STDOUT], &check->directives[CANAL_STREAM_STDERR] };
+    size_t directive_count = 0;
+    for (size_t i = 0; i < NOB_ARRAY_LEN(lists); ++i) directive_count += lists[i]->count;
+    entry->directive_count = 0;
+    entry->directives = arena_alloc(arena, directive_count*sizeof(*entry->directives));
+    for (size_t i = 0; i < NOB_ARRAY_LEN(lists); ++i) {
+        for (size_t j = 0; j < lists[i]->count; ++j) {
+            Canal_Directive *directive = &lists[i]->items[j];
+            entry->directives[entry->directive_count++] = (Index_Directive) {
+                .action = directive->action,
+                .offset = directive->arguments.data - source.data,
+                .count = directive->arguments.count,
+                .timeout_ms = directive->timeout_ms,
+                .stream = directive->stream,
+                .exit_status = directive->exit_status,
+            };
+        }
+    }
+}
+
+// returns false if the entry does not fit the source, which means the file changed after it was indexed
+bool canal_check_from_index(Arena *arena, Canal_Check *check, Index_Entry *entry, String_View source) {
+    if (entry->stamp.size != source.count) return false;
+
+    for (size_t i = 0; i < entry->directive_count; ++i) {
+        Index_Directive *indexed = &entry->directives[i];
+        if (indexed->action >= CANAL_ACTION_COUNT || indexed->stream >= CANAL_STREAM_COUNT
+            || (size_t) indexed->offset + indexed->count > source.count) {
+            *check = (Canal_Check) {0};
+            return false;
+        }
+
+        Canal_Directive directive = {
+            .action = indexed->action,
+            .arguments = sv_from_parts(source.data + indexed->offset, indexed->count),
+            .timeout_ms = indexed->timeout_ms,
+            .exit_status = indexed->exit_status,
+            .stream = indexed->stream,
+        };
+        if (directive.action == CANAL_ACTION_RUN) {
+            arena_da_append(arena, &check->r_directives, directive);
+        } else {
+            arena_da_append(arena, &check->directives[directive.stream], directive);
+        }
+    }
+    check->source_hash = entry->hash;
+    return true;
+}
+
+bool canal_word_pattern(Arena *arena, String_View word, String_View *pattern) {
+    String result = {0};
+    bool has_span = false;
+    size_t i = 0;
+    while (i < word.count) {
+        if (i + 1 < word.count && word.data[i] == '{' && word.data[i + 1] == '{') {
+            const char *end = NULL;
+            for (size_t j = i + 2; j + 1 < word.count; ++j) {
+                if (word.data[j] == '}' && word.data[j + 1] == '}') {
+                    end = word.data + j;
+                    break;
+                }
+            }
+            if (end != NULL) {
+                const char *start = word.data + i + 2;
+                str_append_char(arena, &result, '(');
+                arena_da_append_many(arena, &result, start, end - start);
+                str_append_char(arena, &result, ')');
+                i = end - word.data + 2;
+                has_span = true;
+                continue;
             }
         }
+
+        char ch = word.data[i++];
+        if (strchr(".[]()|*+?\\^$", ch) != NULL) str_append_char(arena, &result, '\\');
+        str_append_char(arena, &result, ch);
     }
+
+    *pattern = sv_from_parts(result.items, result.count);
+    return has_span;
 }
 
-typedef struct {
-    bool err;
-    String error_message;
-    String final_command;
-} Canal_Result;
+Regex *canal_check_regex(Canal_Check *check, String_View pattern, const char **error) {
+    for (size_t i = 0; i < check->regexes.count; ++i) {
+        if (sv_eq(check->regexes.items[i].pattern, pattern)) return check->regexes.items[i].regex;
+    }
 
-typedef struct {
-    Canal_Result *items;
-    size_t count;
-    size_t capacity;
-} Canal_Results;
+    Regex *regex = regex_compile(pattern.data, pattern.count, error);
+    if (regex == NULL) return NULL;
+    Canal_Regex entry = { .pattern = pattern, .regex = regex };
+    nob_da_append(&check->regexes, entry);
+    return regex;
+}
 
-bool canal_run_command(Arena *arena, Nob_Cmd *cmd, String *file_data, Canal_Result *check_result) {
-    bool result = true;
+void canal_check_free_regexes(Canal_Check *check) {
+    for (size_t i = 0; i < check->regexes.count; ++i) {
+        regex_free(check->regexes.items[i].regex);
+    }
+    nob_da_free(check->regexes);
+    check->regexes = (Canal_Regexes) {0};
+}
 
-    // TODO(nic): maybe find a way of creating temp file without fisically creating it
-    const char *temp_out_filepath = "temp.out";
-    const char *temp_err_filepath = "temp.err";
+bool canal_first_token_is_literal(Canal_Directive *directive) {
+    if (directive->token_count == 0) return false;
+    Canal_Token *token = &directive->tokens[0];
+    return token->count > 0 && token->regex == NULL && token->parts == NULL;
+}
 
-    Nob_Fd fdout = nob_fd_open_for_write(temp_out_filepath);
-    assert(fdout != NOB_INVALID_FD);
+void canal_build_automata(Arena *arena, Canal_Directives *directives) {
+    const char *patterns[AHO_MAX_PATTERNS];
+    uint32_t counts[AHO_MAX_PATTERNS];
+    Canal_Directive *members[AHO_MAX_PATTERNS];
+    size_t member_count = 0;
 
-    Nob_Fd fderr = nob_fd_open_for_write(temp_err_filepath);
-    assert(fderr != NOB_INVALID_FD);
+    for (size_t i = 0; i <= directives->count; ++i) {
+        if (i < directives->count) {
+            Canal_Directive *directive = &directives->items[i];
+            if (directive->action == CANAL_ACTION_BANG) {
+                if (!canal_first_token_is_literal(directive)) continue;
 
-    Nob_Cmd_Redirect cmd_redirect = {
-        .fdout = &fdout,
-        .fderr = &fderr,
-    };
+                patterns[member_count] = directive->tokens[0].data;
+                counts[member_count] = directive->tokens[0].count;
+                members[member_count] = directive;
+                member_count += 1;
+                if (member_count < AHO_MAX_PATTERNS) continue;
+            }
+        }
+        if (member_count == 0) continue;
 
-    if (!nob_cmd_run_sync_redirect_and_reset(cmd, cmd_redirect)) {
-        check_result->err = true;
-        canal_read_entire_file(arena, &check_result->error_message, temp_err_filepath);
-        if (check_result->error_message.count <= 0) {
-            str_append_fmt(arena, &check_result->error_message, "<command failed with no message>\n");
+        Canal_Automaton *automaton = arena_alloc(arena, sizeof(*automaton));
+        aho_build(arena, &automaton->aho, patterns, counts, member_count);
+        for (size_t j = 0; j < member_count; ++j) {
+            members[j]->automaton = automaton;
+            automaton->members[j] = members[j];
         }
-        return_defer(false);
+        automaton->member_count = member_count;
+        member_count = 0;
     }
-    canal_read_entire_file(arena, file_data, temp_out_filepath);
+}
 
-defer:
-    nob_delete_file(temp_out_filepath);
-    nob_delete_file(temp_err_filepath);
-    return result;
+// chained over the words, so the hash after n words is the key of the entries with n words
+uint64_t canal_words_hash(uint64_t hash, String_View word) {
+    hash = str_hash(hash, word.data, word.count);
+    return str_hash(hash, " ", 1);
 }
 
-typedef struct {
-    String_View last_line;
-    String_View content;
-    size_t line;
-} Source;
+bool canal_is_plain(Canal_Directive *directive) {
+    return directive->token_count > 0 && directive->words.data != NULL;
+}
 
-String_View canal_source_next_line(Source *source) {
-    source->content = sv_trim_left(source->content);
-    if (source->content.count <= 0) {
-        return (String_View) {0};
+size_t canal_group_bucket(Canal_Group *group, uint64_t hash) {
+    size_t slot = hash & (group->capacity - 1);
+    while (group->buckets[slot] != CANAL_NO_MEMBER && group->hashes[slot] != hash) {
+        slot = (slot + 1) & (group->capacity - 1);
+    }
+    return slot;
+}
+
+Canal_Group_Key *canal_group_key(Canal_Group *group, uint64_t hash, size_t length) {
+    size_t slot = hash & (group->key_capacity - 1);
+    while (group->keys[slot].length != 0 && (group->keys[slot].hash != hash || group->keys[slot].length != length)) {
+        slot = (slot + 1) & (group->key_capacity - 1);
     }
-    String_View line = sv_chop_by_delim(&source->content, '\n');
-    source->line += 1;
-    source->last_line = line;
-    return line;
+    return &group->keys[slot];
 }
 
-typedef bool (*Canal_Action_Func)(Arena *arena, Source *source, String_View arguments, Canal_Result *result);
+void canal_build_group(Arena *arena, Canal_Group *group) {
+    group->entries = arena_alloc(arena, group->count*sizeof(*group->entries));
+    group->order = arena_alloc(arena, group->count*sizeof(*group->order));
+    group->wildcards = arena_alloc(arena, group->count*sizeof(*group->wildcards));
+    uint32_t *entry_of = arena_alloc(arena, group->count*sizeof(*entry_of));
 
-bool canal_lines_match_ignore_whitespace(String_View a, String_View b) {
-    while (a.count > 0 && b.count > 0) {
-        a = sv_trim_left(a);
-        b = sv_trim_left(b);
-        String_View a_word = sv_chop_by_predicate(&a, not_isspace);
-        String_View b_word = sv_chop_by_predicate(&b, not_isspace);
-        if (!sv_eq(a_word, b_word)) {
-            return false;
+    size_t word_count = 0;
+    for (size_t j = 0; j < group->count; ++j) {
+        if (canal_is_plain(&group->members[j])) word_count += group->members[j].token_count;
+    }
+    group->key_capacity = 16;
+    while (group->key_capacity < word_count*2) group->key_capacity *= 2;
+    group->keys = arena_alloc(arena, group->key_capacity*sizeof(*group->keys));
+    memset(group->keys, 0, group->key_capacity*sizeof(*group->keys));
+    group->link_entries = arena_alloc(arena, (word_count + 1)*sizeof(*group->link_entries));
+    group->link_next = arena_alloc(arena, (word_count + 1)*sizeof(*group->link_next));
+    size_t link_count = 0;
+
+    for (size_t j = 0; j < group->count; ++j) {
+        Canal_Directive *member = &group->members[j];
+        if (!canal_is_plain(member)) {
+            if (!canal_first_token_is_literal(member)) group->wildcards[group->wildcard_count++] = (uint32_t) j;
+            continue;
+        }
+
+        uint64_t hash = STR_HASH_SEED;
+        for (size_t t = 0; t < member->token_count; ++t) {
+            hash = canal_words_hash(hash, sv_from_parts(member->tokens[t].data, member->tokens[t].count));
+        }
+        Canal_Group_Key *key = canal_group_key(group, hash, member->token_count);
+        if (key->length == 0) *key = (Canal_Group_Key) { hash, member->token_count, CANAL_NO_MEMBER, CANAL_NO_MEMBER };
+
+        uint32_t e = key->entry;
+        while (e != CANAL_NO_MEMBER && !sv_eq(group->members[group->entries[e].member].words, member->words)) {
+            e = group->entries[e].chain;
+        }
+        if (e == CANAL_NO_MEMBER) {
+            e = (uint32_t) group->entry_count++;
+            group->entries[e] = (Canal_Group_Entry) { .member = (uint32_t) j, .chain = key->entry };
+            key->entry = e;
+            if (member->token_count > group->max_length) group->max_length = member->token_count;
         }
+        entry_of[j] = e;
+        group->entries[e].count += 1;
+    }
+
+    size_t position = 0;
+    for (size_t e = 0; e < group->entry_count; ++e) {
+        Canal_Group_Entry *entry = &group->entries[e];
+        entry->first = position;
+        position += entry->count;
+        entry->count = 0;
+    }
+    for (size_t j = 0; j < group->count; ++j) {
+        if (!canal_is_plain(&group->members[j])) continue;
+        Canal_Group_Entry *entry = &group->entries[entry_of[j]];
+        group->order[entry->first + entry->count++] = (uint32_t) j;
+    }
+
+    // backwards, so the links of every key are in the order the entries are written in
+    for (size_t e = group->entry_count; e-- > 0;) {
+        Canal_Directive *member = &group->members[group->entries[e].member];
+        uint64_t hash = STR_HASH_SEED;
+        for (size_t t = 0; t + 1 < member->token_count; ++t) {
+            hash = canal_words_hash(hash, sv_from_parts(member->tokens[t].data, member->tokens[t].count));
+            Canal_Group_Key *key = canal_group_key(group, hash, t + 1);
+            if (key->length == 0) *key = (Canal_Group_Key) { hash, t + 1, CANAL_NO_MEMBER, CANAL_NO_MEMBER };
+            group->link_entries[link_count] = (uint32_t) e;
+            group->link_next[link_count] = key->longer;
+            key->longer = (uint32_t) link_count++;
+        }
+    }
+
+    group->capacity = 16;
+    while (group->capacity < group->count*2) group->capacity *= 2;
+    group->hashes = arena_alloc(arena, group->capacity*sizeof(*group->hashes));
+    group->buckets = arena_alloc(arena, group->capacity*sizeof(*group->buckets));
+    group->chain = arena_alloc(arena, group->count*sizeof(*group->chain));
+    memset(group->buckets, 0xFF, group->capacity*sizeof(*group->buckets));
+    for (size_t j = group->count; j-- > 0;) {
+        Canal_Directive *member = &group->members[j];
+        if (canal_is_plain(member) || !canal_first_token_is_literal(member)) continue;
+
+        Canal_Token *token = &member->tokens[0];
+        uint64_t hash = canal_words_hash(STR_HASH_SEED, sv_from_parts(token->data, token->count));
+        size_t slot = canal_group_bucket(group, hash);
+        group->hashes[slot] = hash;
+        group->chain[j] = group->buckets[slot];
+        group->buckets[slot] = (uint32_t) j;
     }
-    return true;
 }
 
-bool canal_handle_action_star(Arena *arena, Source *source, String_View arguments, Canal_Result *result) {
-    while (true) {
-        if (source->content.count <= 0) {
-            result->err = true;
-            str_append_fmt(arena, &result->error_message, "%zu: Reached end of input, expected '"SV_Fmt"'\n", source->line, SV_Arg(arguments));
-            return false;
+void canal_build_groups(Arena *arena, Canal_Directives *directives) {
+    size_t i = 0;
+    while (i < directives->count) {
+        if (directives->items[i].action != CANAL_ACTION_AMPERSAND) {
+            i += 1;
+            continue;
         }
 
-        String_View line = canal_source_next_line(source);
-        if (canal_lines_match_ignore_whitespace(line, arguments)) {
-            return true;
+        Canal_Group *group = arena_alloc(arena, sizeof(*group));
+        *group = (Canal_Group) { .members = &directives->items[i], .first = i };
+        while (i + group->count < directives->count && directives->items[i + group->count].action == CANAL_ACTION_AMPERSAND) {
+            group->count += 1;
         }
+        canal_build_group(arena, group);
+
+        directives->items[i].group = group;
+        i += group->count;
     }
 }
 
-bool canal_handle_action_plus(Arena *arena, Source *source, String_View arguments, Canal_Result *result) {
-    if (source->content.count <= 0) {
-        result->err = true;
-        str_append_fmt(arena, &result->error_message, "Unexpected end of input\n");
-        return false;
-    }
-    String_View line = canal_source_next_line(source);
-    if (!canal_lines_match_ignore_whitespace(line, arguments)) {
-        result->err = true;
-        str_append_fmt(arena, &result->error_message, "%zu: Found '"SV_Fmt"', expected '"SV_Fmt"'\n", source->line, SV_Arg(line), SV_Arg(arguments));
-        return false;
+void canal_join_tokens(Arena *arena, Canal_Directive *directive) {
+    String words = {0};
+    for (size_t i = 0; i < directive->token_count; ++i) {
+        Canal_Token *token = &directive->tokens[i];
+        // an empty token would turn into a double space, which scan_words_match can not tell apart
+        if (token->regex != NULL || token->parts != NULL || token->count == 0) return;
+        if (i > 0) str_append_char(arena, &words, ' ');
+        arena_da_append_many(arena, &words, token->data, token->count);
     }
-    return true;
+    directive->words = sv_from_parts(words.items != NULL ? words.items : "", words.count);
 }
 
-bool canal_handle_action_bang(Arena *arena, Source *source, String_View arguments, Canal_Result *result) {
-    String_View line = source->last_line;
-    if (canal_lines_match_ignore_whitespace(line, arguments)) {
-        result->err = true;
-        str_append_fmt(arena, &result->error_message, "%zu: Found unexpected '"SV_Fmt"'\n", source->line, SV_Arg(line), SV_Arg(arguments));
-        return false;
+#define CANAL_NO_VARIABLE UINT32_MAX
+
+typedef struct {
+    String_View *names;
+    uint32_t *indices;
+    size_t count;
+    size_t capacity;
+} Canal_Variables;
+
+size_t canal_variable_slot(Canal_Variables *variables, String_View name) {
+    size_t mask = variables->capacity - 1;
+    size_t i = str_hash(STR_HASH_SEED, name.data, name.count) & mask;
+    while (variables->names[i].data != NULL && !sv_eq(variables->names[i], name)) {
+        i = (i + 1) & mask;
     }
-    return true;
+    return i;
 }
 
-static_assert(CANAL_ACTION_COUNT == 4, "Number of actions change, update code here!");
-Canal_Action_Func canal_action_funcs[] = {
-    [CANAL_ACTION_STAR] = canal_handle_action_star,
-    [CANAL_ACTION_PLUS] = canal_handle_action_plus,
-    [CANAL_ACTION_BANG] = canal_handle_action_bang,
-    [CANAL_ACTION_RUN] = NULL,
-};
+uint32_t canal_variable_find(Canal_Variables *variables, String_View name) {
+    if (variables->capacity == 0) return CANAL_NO_VARIABLE;
+    size_t i = canal_variable_slot(variables, name);
+    return variables->names[i].data != NULL ? variables->indices[i] : CANAL_NO_VARIABLE;
+}
 
-void canal_match(Arena *arena, Source source, Canal_Directives *directives, Canal_Result *result) {
-    for (size_t i = 0; i < directives->count; ++i) {
-        Canal_Directive *directive = &directives->items[i];
-        assert(directive->action != CANAL_ACTION_RUN);
+uint32_t canal_variable_add(Arena *arena, Canal_Variables *variables, String_View name) {
+    uint32_t index = canal_variable_find(variables, name);
+    if (index != CANAL_NO_VARIABLE) return index;
 
-        Canal_Action_Func action_func = canal_action_funcs[directive->action];
-        if (!action_func(arena, &source, directive->arguments, result)) {
-            return;
+    if ((variables->count + 1)*2 > variables->capacity) {
+        Canal_Variables grown = { .count = variables->count };
+        grown.capacity = variables->capacity == 0 ? 64 : variables->capacity*2;
+        grown.names = arena_alloc(arena, grown.capacity*sizeof(*grown.names));
+        grown.indices = arena_alloc(arena, grown.capacity*sizeof(*grown.indices));
+        memset(grown.names, 0, grown.capacity*sizeof(*grown.names));
+        for (size_t i = 0; i < variables->capacity; ++i) {
+            if (variables->names[i].data == NULL) continue;
+            size_t j = canal_variable_slot(&grown, variables->names[i]);
+            grown.names[j] = variables->names[i];
+            grown.indices[j] = variables->indices[i];
         }
+        *variables = grown;
     }
+
+    size_t i = canal_variable_slot(variables, name);
+    variables->names[i] = name;
+    variables->indices[i] = (uint32_t) variables->count;
+    return (uint32_t) variables->count++;
 }
 
-Canal_Results canal_check(Arena *arena, Nob_Cmd *cmd, Canal_Check *check, const char *filepath) {
-    Canal_Results results = {0};
+bool canal_is_variable_name(String_View name) {
+    if (name.count == 0 || isdigit((unsigned char) name.data[0])) return false;
+    for (size_t i = 0; i < name.count; ++i) {
+        if (!isalnum((unsigned char) name.data[i]) && name.data[i] != '_') return false;
+    }
+    return true;
+}
 
-    for (size_t i = 0; i < check->r_directives.count; ++i) {
-        Canal_Directive *r_directive = &check->r_directives.items[i];
-        assert(r_directive->action == CANAL_ACTION_RUN);
+bool canal_word_parts(Arena *arena, Canal_Check *check, Canal_Variables *variables, Canal_Directive *directive, String_View word, Canal_Token *token, String *error) {
+    token->parts = arena_alloc(arena, word.count*sizeof(*token->parts));
+    token->part_count = 0;
+    size_t literal = 0;
+    size_t i = 0;
+    while (i < word.count) {
+        bool capture = i + 1 < word.count && word.data[i] == '[' && word.data[i + 1] == '[';
+        bool span = i + 1 < word.count && word.data[i] == '{' && word.data[i + 1] == '{';
+        if (!capture && !span) {
+            i += 1;
+            continue;
+        }
 
-        arena_da_append(arena, &results, (Canal_Result) {0});
-        Canal_Result *result = &results.items[results.count - 1];
+        const char *close = capture ? "]]" : "}}";
+        size_t end = i + 2;
+        while (end + 1 < word.count && memcmp(word.data + end, close, 2) != 0) end += 1;
+        if (end + 1 >= word.count) {
+            if (span) {
+                i += 1;
+                continue;
+            }
+            str_append_fmt(arena, error, "missing ']]' in '"SV_Fmt"'\n", SV_Arg(word));
+            return false;
+        }
 
-        String_View args = r_directive->arguments;
-        while (args.count > 0) {
-            args = sv_trim_left(args);
-            String_View arg_fmt = sv_chop_by_predicate(&args, not_isspace);
-            if (arg_fmt.count == 0) break;
+        if (i > literal) {
+            token->parts[token->part_count++] = (Canal_Part) {
+                .kind = CANAL_PART_LITERAL,
+                .text = sv_from_parts(word.data + literal, i - literal),
+                .slot = CANAL_NO_SLOT,
+            };
+        }
 
-            // TODO(nic): implement proper formatting
-            String arg = {0};
-            if (sv_eq(arg_fmt, sv_from_cstr("%s"))) {
-                str_append_cstr(arena, &arg, filepath);
-                str_append_null(arena, &arg);
+        // a pattern may end in a class like `[a-z]`, so the capture ends at the last of a run of `]`
+        if (capture) {
+            while (end + 2 < word.count && word.data[end + 2] == ']') end += 1;
+        }
+
+        String_View pattern = sv_from_parts(word.data + i + 2, end - i - 2);
+        Canal_Part part = { .kind = CANAL_PART_PATTERN, .variable = CANAL_NO_VARIABLE, .slot = CANAL_NO_SLOT };
+        if (capture) {
+            String_View rest = pattern;
+            String_View name = sv_chop_by_delim(&rest, ':');
+            if (!canal_is_variable_name(name)) {
+                str_append_fmt(arena, error, "invalid variable name '"SV_Fmt"' in '"SV_Fmt"'\n", SV_Arg(name), SV_Arg(word));
+                return false;
+            }
+
+            if (name.count < pattern.count) {
+                pattern = rest;
+                part.variable = canal_variable_add(arena, variables, name);
+                part.slot = (uint32_t) directive->bind_count;
+                directive->binds[directive->bind_count++] = part.variable;
             } else {
-                str_append_sv(arena, &arg, arg_fmt);
-                str_append_null(arena, &arg);
+                part.kind = CANAL_PART_USE;
+                part.variable = canal_variable_find(variables, name);
+                if (part.variable == CANAL_NO_VARIABLE) {
+                    str_append_fmt(arena, error, "undefined variable '"SV_Fmt"' in '"SV_Fmt"'\n", SV_Arg(name), SV_Arg(word));
+                    return false;
+                }
+                for (size_t j = directive->bind_count; j > 0; --j) {
+                    if (directive->binds[j - 1] == part.variable) {
+                        part.slot = (uint32_t) (j - 1);
+                        break;
+                    }
+                }
             }
-            nob_cmd_append(cmd, arg.items);
         }
-        // NOTE(nic): Nob_String_Builder and String are the same thing
-        nob_cmd_render(*cmd, (Nob_String_Builder*)&result->final_command);
 
-        String file_data = {0};
-        if (!canal_run_command(arena, cmd, &file_data, result)) {
-            continue;
+        if (part.kind == CANAL_PART_PATTERN) {
+            const char *regex_error = NULL;
+            part.regex = canal_check_regex(check, pattern, &regex_error);
+            if (part.regex == NULL) {
+                str_append_fmt(arena, error, "invalid pattern in '"SV_Fmt"': %s\n", SV_Arg(word), regex_error);
+                return false;
+            }
         }
+        token->parts[token->part_count++] = part;
+        i = end + 2;
+        literal = i;
+    }
 
-        Source source = {0};
-        source.content = sv_from_parts(file_data.items, file_data.count);
-        canal_match(arena, source, &check->directives, result);
+    if (word.count > literal) {
+        token->parts[token->part_count++] = (Canal_Part) {
+            .kind = CANAL_PART_LITERAL,
+            .text = sv_from_parts(word.data + literal, word.count - literal),
+            .slot = CANAL_NO_SLOT,
+        };
     }
+    return true;
+}
 
-    return results;
+bool canal_word_has_variable(String_View word) {
+    for (size_t i = 0; i + 1 < word.count; ++i) {
+        if (word.data[i] == '[' && word.data[i + 1] == '[') return true;
+    }
+    return false;
 }
 
-int main(int argc, const char **argv) {
-    nob_minimal_log_level = NOB_NO_LOGS;
+// a trailing run of whitespace in the arguments ends up as an empty word, and a `{{regex}}` span ends at the first
+// whitespace like any other word
+bool canal_compile_stream(Arena *arena, Canal_Check *check, Canal_Directives *directives, String *error) {
+    Canal_Variables variables = {0};
+    for (size_t i = 0; i < directives->count; ++i) {
+        Canal_Directive *directive = &directives->items[i];
+        if (directive->action == CANAL_ACTION_RUN) continue;
 
-    if (argc <= 1) {
-        fprintf(stderr, "Error: expected filepath\n");
-        exit(1);
+        size_t capacity = directive->arguments.count/2 + 1;
+        directive->tokens = arena_alloc(arena, capacity*sizeof(*directive->tokens));
+        directive->token_count = 0;
+        directive->bind_count = 0;
+        if (canal_word_has_variable(directive->arguments)) {
+            size_t bind_capacity = directive->arguments.count/4 + 1;
+            directive->binds = arena_alloc(arena, bind_capacity*sizeof(*directive->binds));
+            directive->bound = arena_alloc(arena, bind_capacity*sizeof(*directive->bound));
+        }
+
+        String_View arguments = directive->arguments;
+        while (arguments.count > 0) {
+            arguments = sv_trim_left(arguments);
+            String_View word = sv_chop_by_predicate(&arguments, not_isspace);
+            assert(directive->token_count < capacity);
+            Canal_Token token = {
+                .data = word.data,
+                .count = (uint32_t) word.count,
+                .first = word.count > 0 ? word.data[0] : '\0',
+            };
+
+            String_View pattern;
+            if (canal_word_has_variable(word)) {
+                if (!canal_word_parts(arena, check, &variables, directive, word, &token, error)) return false;
+            } else if (canal_word_pattern(arena, word, &pattern)) {
+                const char *regex_error = NULL;
+                token.regex = canal_check_regex(check, pattern, &regex_error);
+                if (token.regex == NULL) {
+                    str_append_fmt(arena, error, "invalid pattern in '"SV_Fmt"': %s\n", SV_Arg(word), regex_error);
+                    return false;
+                }
+            }
+            directive->tokens[directive->token_count++] = token;
+        }
+
+        canal_join_tokens(arena, directive);
     }
-    const char *filepath = argv[1];
 
-    Arena arena = {0};
-    String file_data = {0};
+    if (variables.count > check->variable_count) check->variable_count = variables.count;
+    canal_build_automata(arena, directives);
+    canal_build_groups(arena, directives);
+    return true;
+}
 
-    Errno err = canal_read_entire_file(&arena, &file_data, filepath);
-    if (err) {
-        fprintf(stderr, "Error: could not read file '%s': %s\n", filepath, strerror(err));
-        exit(1);
+// the streams are not matched in any order to each other, so a variable can only be used in the stream that captured it
+bool canal_compile_directives(Arena *arena, Canal_Check *check, String *error) {
+    for (size_t i = 0; i < CANAL_STREAM_COUNT; ++i) {
+        if (!canal_compile_stream(arena, check, &check->directives[i], error)) return false;
     }
+    return true;
+}
 
-    String_View source = sv_from_parts(file_data.items, file_data.count);
-    Canal_Check check = {0};
-    canal_collect_directives(&arena, &check, source);
+typedef struct {
+    bool err;
+    String error_message;
+    String final_command;
+} Canal_Result;
 
-    Nob_Cmd cmd = {0};
-    Canal_Results results = canal_check(&arena, &cmd, &check, filepath);
-    nob_cmd_free(cmd);
+typedef enum {
+    CANAL_CAPTURE_AUTO,
+    CANAL_CAPTURE_PIPE,
+    CANAL_CAPTURE_MEMFD,
+    CANAL_CAPTURE_COUNT,
+} Canal_Capture;
 
-    for (size_t i = 0; i < results.count; ++i) {
-        Canal_Result *result = &results.items[i];
-        printf("[Check %zu] ("STR_FMT"):\n", i + 1, STR_ARG(&result->final_command));
+static_assert(CANAL_CAPTURE_COUNT == 3, "Number of capture backends change, update code here!");
+const char *canal_capture_names[] = {
+    [CANAL_CAPTURE_AUTO] = "auto",
+    [CANAL_CAPTURE_PIPE] = "pipe",
+    [CANAL_CAPTURE_MEMFD] = "memfd",
+};
 
-        if (result->err) {
-            fprintf(stderr, STR_FMT, STR_ARG(&result->error_message));
+#define CANAL_READ_CHUNK (64*1024)
+
+#define CANAL_MEMFD_THRESHOLD (1024*1024)
+
+typedef struct {
+    Canal_Capture capture;
+    // a passing command still runs to the end, its exit status has to be checked
+    bool kill_early;
+    size_t window;
+    uint64_t timeout_ms;
+    size_t command_jobs;
+    const char *cache_dir;
+    size_t cache_limit;
+} Canal_Options;
+
+#define CANAL_DEFAULT_CACHE_DIR ".canal-cache"
+#define CANAL_DEFAULT_CACHE_LIMIT (512*1024*1024)
+
+typedef struct {
+    String data;
+    bool mapped;
+} Canal_Output;
+
+void canal_output_release(Canal_Output *output) {
+#ifndef _WIN32
+    if (output->mapped) {
+        munmap(output->data.items, output->data.count);
+    }
+#endif
+    *output = (Canal_Output) {0};
+}
+
+Errno canal_load_file(Arena *arena, Canal_Output *file, const char *filepath) {
+#ifndef _WIN32
+    Errno result = 0;
+
+    int fd = open(filepath, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return errno;
+
+    struct stat statbuf;
+    if (fstat(fd, &statbuf) < 0) return_defer(errno);
+
+    if (S_ISREG(statbuf.st_mode) && statbuf.st_size > 0) {
+        void *data = mmap(NULL, statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            madvise(data, statbuf.st_size, MADV_SEQUENTIAL);
+            file->data.items = data;
+            file->data.count = statbuf.st_size;
+            file->data.capacity = statbuf.st_size;
+            file->mapped = true;
+            return_defer(0);
+        }
+    }
+
+    while (true) {
+        str_reserve(arena, &file->data, CANAL_READ_CHUNK);
+        ssize_t n = read(fd, file->data.items + file->data.count, file->data.capacity - file->data.count);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return_defer(errno);
+        if (n == 0) break;
+        file->data.count += n;
+    }
+
+defer:
+    close(fd);
+    return result;
+#else
+    return canal_read_entire_file(arena, &file->data, filepath);
+#endif // _WIN32
+}
+
+typedef struct {
+    Canal_Result *items;
+    size_t count;
+    size_t capacity;
+} Canal_Results;
+
+// the table of lines is built a chunk at a time, the data may move between feeds but the offsets do not
+typedef struct {
+    const char *data;
+    size_t count;
+    Scan_Lines *lines;
+    size_t next;
+    size_t dropped;
+    bool eof;
+    String_View *bindings;
+    // the line numbers of the group count from the start of the output, so compaction does not change them
+    bool grouping;
+    size_t group_line;
+    size_t group_start;
+    size_t group_end;
+    size_t group_left;
+    size_t *group_owners;
+    uint32_t *taken;
+    uint32_t *group_visits;
+    size_t group_visit_count;
+    uint32_t group_visit;
+    // only the first directive of each automaton is in here, it stands in for the others
+    Canal_Directive **bangs;
+    size_t bang_count;
+    size_t bang_line;
+    String_View *bang_bindings;
+    size_t variable_count;
+    Regex_Ends ends;
+} Source;
+
+String_View canal_source_line_at(Source *source, size_t index) {
+    Scan_Line *line = &source->lines->items[index];
+    return sv_from_parts(source->data + line->start, line->end - line->start);
+}
+
+size_t canal_source_line(Source *source) {
+    return source->dropped + source->next;
+}
+
+#define CANAL_NO_LINE SIZE_MAX
+
+#define CANAL_INDEX_CHUNK (64*1024)
+
+bool canal_source_has_line_at(Source *source, size_t index) {
+    Scan_Lines *lines = source->lines;
+    while (index >= lines->count) {
+        if (lines->scanned >= source->count && (!source->eof || lines->open == SCAN_NO_LINE)) return false;
+        size_t end = lines->scanned + CANAL_INDEX_CHUNK < source->count ? lines->scanned + CANAL_INDEX_CHUNK : source->count;
+        scan_index_lines(source->data, end, source->eof && end == source->count, lines);
+    }
+    return true;
+}
+
+bool canal_source_has_line(Source *source) {
+    return canal_source_has_line_at(source, source->next);
+}
+
+String_View canal_source_next_line(Source *source) {
+    if (!canal_source_has_line(source)) {
+        return (String_View) {0};
+    }
+    return canal_source_line_at(source, source->next++);
+}
+
+typedef enum {
+    CANAL_STEP_DONE,
+    CANAL_STEP_FAILED,
+    CANAL_STEP_MORE,
+} Canal_Step;
+
+typedef Canal_Step (*Canal_Action_Func)(Arena *arena, Source *source, Canal_Directive *directive, Canal_Result *result);
+
+// a pattern tries its longest match first and backs off if the parts after it do not match. The ends of the
+// matches of each pattern are kept on top of each other in `ends`
+bool canal_parts_match(String_View word, size_t at, Canal_Token *token, size_t part, Canal_Directive *directive, String_View *bindings, Regex_Ends *ends) {
+    if (part == token->part_count) return at == word.count;
+
+    Canal_Part *current = &token->parts[part];
+    if (current->kind == CANAL_PART_PATTERN) {
+        size_t base = ends->count;
+        regex_match_prefixes(current->regex, word.data + at, word.count - at, ends);
+        bool matched = false;
+        for (size_t i = ends->count; !matched && i-- > base;) {
+            size_t end = at + ends->items[i];
+            if (current->slot != CANAL_NO_SLOT) directive->bound[current->slot] = sv_from_parts(word.data + at, end - at);
+            matched = canal_parts_match(word, end, token, part + 1, directive, bindings, ends);
+        }
+        ends->count = base;
+        return matched;
+    }
+
+    String_View text = current->text;
+    if (current->kind == CANAL_PART_USE) {
+        text = current->slot != CANAL_NO_SLOT ? directive->bound[current->slot] : bindings[current->variable];
+    }
+    if (word.count - at < text.count || (text.count > 0 && memcmp(word.data + at, text.data, text.count) != 0)) return false;
+    return canal_parts_match(word, at + text.count, token, part + 1, directive, bindings, ends);
+}
+
+// the reference scan_words_match has to agree with
+bool canal_line_matches_tokens(String_View line, Canal_Directive *directive, String_View *bindings, Regex_Ends *ends) {
+    for (size_t i = 0; i < directive->bind_count; ++i) directive->bound[i] = (String_View) {0};
+    for (size_t i = 0; i < directive->token_count && line.count > 0; ++i) {
+        line = sv_trim_left(line);
+        String_View word = sv_chop_by_predicate(&line, not_isspace);
+
+        Canal_Token *token = &directive->tokens[i];
+        if (token->parts != NULL) {
+            if (!canal_parts_match(word, 0, token, 0, directive, bindings, ends)) return false;
+            continue;
+        }
+        if (token->regex != NULL) {
+            if (!regex_match(token->regex, word.data, word.count)) return false;
+            continue;
+        }
+        if (word.count != token->count) return false;
+        if (word.count == 0) continue;
+        if (word.data[0] != token->first) return false;
+        if (memcmp(word.data, token->data, word.count) != 0) return false;
+    }
+    return true;
+}
+
+// the values are copied out of the output, which can move or be dropped before the variables are used
+bool canal_line_matches(Arena *arena, Source *source, String_View line, Canal_Directive *directive) {
+    if (directive->words.data != NULL) {
+        return scan_words_match(line.data, line.count, directive->words.data, directive->words.count);
+    }
+    if (!canal_line_matches_tokens(line, directive, source->bindings, &source->ends)) return false;
+
+    for (size_t i = 0; i < directive->bind_count; ++i) {
+        String_View value = directive->bound[i];
+        if (value.data == NULL) continue;
+        char *copy = arena_alloc(arena, value.count + 1);
+        memcpy(copy, value.data, value.count);
+        source->bindings[directive->binds[i]] = sv_from_parts(copy, value.count);
+    }
+    return true;
+}
+
+uint64_t canal_first_word_hits(String_View line, Aho *automaton, size_t *length) {
+    uint32_t state = 0;
+    size_t i = 0;
+    while (i < line.count && !isspace((unsigned char) line.data[i])) {
+        state = automaton->next[state*256 + (uint8_t) line.data[i]];
+        i += 1;
+        if (automaton->depths[state] != i) return 0;
+    }
+    *length = i;
+    return automaton->hits[state];
+}
+
+size_t canal_source_find_line(Source *source, size_t offset) {
+    Scan_Lines *lines = source->lines;
+    size_t lo = source->next;
+    size_t step = 1;
+    while (lo + step < lines->count && lines->items[lo + step].start <= offset) {
+        lo += step;
+        step *= 2;
+    }
+    size_t hi = lo + step < lines->count ? lo + step : lines->count;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo)/2;
+        if (source->lines->items[mid].start <= offset) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// a line can only match if its first word is the first token, so the output is searched for that token
+Canal_Step canal_handle_action_star_skip(Arena *arena, Source *source, Canal_Directive *directive, Canal_Result *result) {
+    Canal_Token *token = &directive->tokens[0];
+    Scan_Lines *lines = source->lines;
+    while (canal_source_has_line(source)) {
+        size_t from = lines->items[source->next].start;
+        size_t hit = scan_find(source->data, lines->items[lines->count - 1].end, from, token->data, token->count);
+        if (hit >= lines->items[lines->count - 1].end) {
+            source->next = lines->count;
+            continue;
+        }
+
+        size_t index = canal_source_find_line(source, hit);
+        Scan_Line *line = &lines->items[index];
+        size_t word_end = hit + token->count;
+        source->next = index + 1;
+        if (line->start != hit || (word_end < line->end && !isspace((unsigned char) source->data[word_end]))) {
+            continue;
+        }
+        if (canal_line_matches(arena, source, canal_source_line_at(source, index), directive)) {
+            return CANAL_STEP_DONE;
+        }
+    }
+
+    if (!source->eof) return CANAL_STEP_MORE;
+    result->err = true;
+    str_append_fmt(arena, &result->error_message, "%zu: Reached end of input, expected '"SV_Fmt"'\n", canal_source_line(source), SV_Arg(directive->arguments));
+    return CANAL_STEP_FAILED;
+}
+
+Canal_Step canal_handle_action_star(Arena *arena, Source *source, Canal_Directive *directive, Canal_Result *result) {
+    if (canal_first_token_is_literal(directive)) {
+        return canal_handle_action_star_skip(arena, source, directive, result);
+    }
+
+    while (true) {
+        if (!canal_source_has_line(source)) {
+            if (!source->eof) return CANAL_STEP_MORE;
+            result->err = true;
+            str_append_fmt(arena, &result->error_message, "%zu: Reached end of input, expected '"SV_Fmt"'\n", canal_source_line(source), SV_Arg(directive->arguments));
+            return CANAL_STEP_FAILED;
+        }
+
+        String_View line = canal_source_next_line(source);
+        if (canal_line_matches(arena, source, line, directive)) {
+            return CANAL_STEP_DONE;
+        }
+    }
+}
+
+Canal_Step canal_handle_action_plus(Arena *arena, Source *source, Canal_Directive *directive, Canal_Result *result) {
+    if (!canal_source_has_line(source)) {
+        if (!source->eof) return CANAL_STEP_MORE;
+        result->err = true;
+        str_append_fmt(arena, &result->error_message, "Unexpected end of input\n");
+        return CANAL_STEP_FAILED;
+    }
+    String_View line = canal_source_next_line(source);
+    if (!canal_line_matches(arena, source, line, directive)) {
+        result->err = true;
+        str_append_fmt(arena, &result->error_message, "%zu: Found '"SV_Fmt"', expected '"SV_Fmt"'\n", canal_source_line(source), SV_Arg(line), SV_Arg(directive->arguments));
+        return CANAL_STEP_FAILED;
+    }
+    return CANAL_STEP_DONE;
+}
+
+// a `!` can only be checked once the next directive matched, until then it waits in source->bangs
+Canal_Step canal_handle_action_bang(Arena *arena, Source *source, Canal_Directive *directive, Canal_Result *result) {
+    NOB_UNUSED(arena);
+    NOB_UNUSED(result);
+    if (source->bang_count == 0) {
+        source->bang_line = source->dropped + source->next;
+        memcpy(source->bang_bindings, source->bindings, source->variable_count*sizeof(*source->bindings));
+    }
+    if (directive->automaton == NULL || directive->automaton->members[0] == directive) {
+        source->bangs[source->bang_count++] = directive;
+    }
+    return CANAL_STEP_DONE;
+}
+
+Canal_Step canal_check_bangs(Arena *arena, Source *source, size_t end, Canal_Result *result) {
+    String_View *bindings = source->bindings;
+    source->bindings = source->bang_bindings;
+
+    Canal_Step step = CANAL_STEP_DONE;
+    while (step == CANAL_STEP_DONE && source->bang_line < end && canal_source_has_line_at(source, source->bang_line - source->dropped)) {
+        String_View line = canal_source_line_at(source, source->bang_line - source->dropped);
+        bool found = false;
+        for (size_t i = 0; i < source->bang_count && !found; ++i) {
+            Canal_Directive *directive = source->bangs[i];
+            Canal_Automaton *automaton = directive->automaton;
+            if (automaton == NULL) {
+                found = canal_line_matches(arena, source, line, directive);
+                continue;
+            }
+
+            size_t length = 0;
+            uint64_t hits = canal_first_word_hits(line, &automaton->aho, &length);
+            for (size_t j = 0; hits != 0 && !found; ++j, hits >>= 1) {
+                Canal_Directive *member = automaton->members[j];
+                found = (hits & 1) && member->tokens[0].count == length && canal_line_matches(arena, source, line, member);
+            }
+        }
+        if (found) {
+            result->err = true;
+            str_append_fmt(arena, &result->error_message, "%zu: Found unexpected '"SV_Fmt"'\n", source->bang_line + 1, SV_Arg(line));
+            step = CANAL_STEP_FAILED;
+        }
+        if (step == CANAL_STEP_DONE) source->bang_line += 1;
+    }
+
+    source->bindings = bindings;
+    return step;
+}
+
+bool canal_group_assign(Arena *arena, Source *source, Canal_Group *group, size_t line_number);
+
+bool canal_group_reassign(Arena *arena, Source *source, Canal_Group *group, uint32_t j, size_t line_number) {
+    uint32_t *visit = &source->group_visits[group->first + j];
+    if (*visit == source->group_visit) return false;
+    *visit = source->group_visit;
+
+    size_t *owner = &source->group_owners[group->first + j];
+    if (!canal_group_assign(arena, source, group, *owner)) return false;
+    *owner = line_number;
+    return true;
+}
+
+bool canal_group_offer_entry(Arena *arena, Source *source, Canal_Group *group, Canal_Group_Entry *entry, size_t line_number, String_View line, bool free_only, bool *owned) {
+    if (!canal_line_matches(arena, source, line, &group->members[entry->member])) return false;
+
+    uint32_t *taken = &source->taken[group->first + (entry - group->entries)];
+    if (free_only) {
+        if (*taken >= entry->count) {
+            *owned = true;
+            return false;
+        }
+        source->group_owners[group->first + group->order[entry->first + *taken]] = line_number;
+        *taken += 1;
+        return true;
+    }
+    for (uint32_t k = 0; k < *taken; ++k) {
+        if (canal_group_reassign(arena, source, group, group->order[entry->first + k], line_number)) return true;
+    }
+    return false;
+}
+
+bool canal_group_offer(Arena *arena, Source *source, Canal_Group *group, uint32_t j, size_t line_number, String_View line, bool free_only, bool *owned) {
+    size_t *owner = &source->group_owners[group->first + j];
+    if (free_only != (*owner == CANAL_NO_LINE)) {
+        *owned = true;
+        return false;
+    }
+    if (!free_only && source->group_visits[group->first + j] == source->group_visit) return false;
+    if (!canal_line_matches_tokens(line, &group->members[j], source->bindings, &source->ends)) return false;
+    if (free_only) {
+        *owner = line_number;
+        return true;
+    }
+    return canal_group_reassign(arena, source, group, j, line_number);
+}
+
+bool canal_group_offer_line(Arena *arena, Source *source, Canal_Group *group, size_t line_number, bool free_only, bool *owned) {
+    String_View line = canal_source_line_at(source, line_number - source->dropped);
+
+    // split exactly like canal_line_matches_tokens does it
+    String_View rest = line;
+    uint64_t hash = STR_HASH_SEED;
+    uint64_t first_hash = 0;
+    size_t length = 0;
+    while (rest.count > 0 && length < group->max_length) {
+        rest = sv_trim_left(rest);
+        hash = canal_words_hash(hash, sv_chop_by_predicate(&rest, not_isspace));
+        length += 1;
+        if (length == 1) first_hash = hash;
+
+        Canal_Group_Key *key = canal_group_key(group, hash, length);
+        if (key->length == 0) break;
+        for (uint32_t e = key->entry; e != CANAL_NO_MEMBER; e = group->entries[e].chain) {
+            if (canal_group_offer_entry(arena, source, group, &group->entries[e], line_number, line, free_only, owned)) return true;
+        }
+        // a line that runs out of words matches every entry that starts with all of them
+        if (rest.count == 0) {
+            for (uint32_t link = key->longer; link != CANAL_NO_MEMBER; link = group->link_next[link]) {
+                if (canal_group_offer_entry(arena, source, group, &group->entries[group->link_entries[link]], line_number, line, free_only, owned)) return true;
+            }
+        }
+    }
+
+    if (length == 0) {
+        String_View first = line;
+        first_hash = canal_words_hash(STR_HASH_SEED, sv_chop_by_predicate(&first, not_isspace));
+    }
+    size_t slot = canal_group_bucket(group, first_hash);
+    for (uint32_t j = group->buckets[slot]; j != CANAL_NO_MEMBER; j = group->chain[j]) {
+        if (canal_group_offer(arena, source, group, j, line_number, line, free_only, owned)) return true;
+    }
+    for (size_t k = 0; k < group->wildcard_count; ++k) {
+        if (canal_group_offer(arena, source, group, group->wildcards[k], line_number, line, free_only, owned)) return true;
+    }
+    return false;
+}
+
+bool canal_group_assign(Arena *arena, Source *source, Canal_Group *group, size_t line_number) {
+    // `owned` is set when a member the line may match already has a line, otherwise there is nothing to move
+    bool owned = false;
+    if (canal_group_offer_line(arena, source, group, line_number, true, &owned)) return true;
+    return owned && canal_group_offer_line(arena, source, group, line_number, false, &owned);
+}
+
+// the lines and the members are a bipartite matching and every line is only tried once, so a line that can not be
+// matched when it comes up never can be and the group is done at the first line that completes it
+Canal_Step canal_handle_action_ampersand(Arena *arena, Source *source, Canal_Directive *directive, Canal_Result *result) {
+    Canal_Group *group = directive->group;
+    if (group == NULL) return CANAL_STEP_DONE;
+
+    size_t *owners = source->group_owners + group->first;
+    if (!source->grouping) {
+        source->grouping = true;
+        source->group_line = source->dropped + source->next;
+        source->group_end = source->group_line;
+        source->group_left = group->count;
+        for (size_t j = 0; j < group->count; ++j) owners[j] = CANAL_NO_LINE;
+        memset(source->taken + group->first, 0, group->entry_count*sizeof(*source->taken));
+    }
+
+    while (source->group_left > 0 && canal_source_has_line_at(source, source->group_line - source->dropped)) {
+        size_t line_number = source->group_line++;
+        source->group_visit += 1;
+        if (source->group_visit == 0) {
+            memset(source->group_visits, 0, source->group_visit_count*sizeof(*source->group_visits));
+            source->group_visit = 1;
+        }
+        if (canal_group_assign(arena, source, group, line_number)) {
+            if (source->group_left == group->count) source->group_start = line_number;
+            source->group_left -= 1;
+            source->group_end = source->group_line;
+        }
+    }
+
+    if (source->group_left > 0) {
+        if (!source->eof) return CANAL_STEP_MORE;
+        source->grouping = false;
+        size_t j = 0;
+        while (owners[j] != CANAL_NO_LINE) j += 1;
+        result->err = true;
+        str_append_fmt(arena, &result->error_message, "%zu: Reached end of input, expected '"SV_Fmt"'\n", source->group_line, SV_Arg(group->members[j].arguments));
+        return CANAL_STEP_FAILED;
+    }
+
+    // a line can still move to another member until the group is done, so the captures only bind now
+    for (size_t j = 0; j < group->count; ++j) {
+        Canal_Directive *member = &group->members[j];
+        if (member->bind_count == 0) continue;
+        canal_line_matches(arena, source, canal_source_line_at(source, owners[j] - source->dropped), member);
+    }
+
+    source->grouping = false;
+    source->next = source->group_end - source->dropped;
+    return CANAL_STEP_DONE;
+}
+
+static_assert(CANAL_ACTION_COUNT == 5, "Number of actions change, update code here!");
+Canal_Action_Func canal_action_funcs[] = {
+    [CANAL_ACTION_STAR] = canal_handle_action_star,
+    [CANAL_ACTION_PLUS] = canal_handle_action_plus,
+    [CANAL_ACTION_BANG] = canal_handle_action_bang,
+    [CANAL_ACTION_RUN] = NULL,
+    [CANAL_ACTION_AMPERSAND] = canal_handle_action_ampersand,
+};
+
+typedef enum {
+    CANAL_MATCH_PENDING,
+    CANAL_MATCH_PASSED,
+    CANAL_MATCH_FAILED,
+} Canal_Match_Status;
+
+typedef struct {
+    Canal_Directives *directives;
+    size_t directive;
+    Source source;
+    Scan_Lines lines;
+    Canal_Match_Status status;
+} Canal_Matcher;
+
+Canal_Matcher canal_matcher_new(Arena *arena, Canal_Check *check, Canal_Stream stream) {
+    Canal_Directives *directives = &check->directives[stream];
+    Canal_Matcher matcher = {0};
+    matcher.directives = directives;
+    matcher.lines.open = SCAN_NO_LINE;
+    if (directives->count == 0) matcher.status = CANAL_MATCH_PASSED;
+    matcher.source.bindings = arena_alloc(arena, (check->variable_count + 1)*sizeof(*matcher.source.bindings));
+    memset(matcher.source.bindings, 0, (check->variable_count + 1)*sizeof(*matcher.source.bindings));
+    matcher.source.group_owners = arena_alloc(arena, (directives->count + 1)*sizeof(*matcher.source.group_owners));
+    matcher.source.group_visit_count = directives->count + 1;
+    matcher.source.group_visits = arena_alloc(arena, matcher.source.group_visit_count*sizeof(*matcher.source.group_visits));
+    memset(matcher.source.group_visits, 0, matcher.source.group_visit_count*sizeof(*matcher.source.group_visits));
+    matcher.source.taken = arena_alloc(arena, (directives->count + 1)*sizeof(*matcher.source.taken));
+    matcher.source.bangs = arena_alloc(arena, (directives->count + 1)*sizeof(*matcher.source.bangs));
+    matcher.source.bang_bindings = arena_alloc(arena, (check->variable_count + 1)*sizeof(*matcher.source.bang_bindings));
+    matcher.source.variable_count = check->variable_count;
+    return matcher;
+}
+
+// the lines a directive went past while it waits for more output can be checked against the `!` before it right away
+size_t canal_source_skipped_end(Source *source, Canal_Directive *directive) {
+    switch (directive->action) {
+    case CANAL_ACTION_STAR:
+        return source->dropped + source->next;
+    case CANAL_ACTION_AMPERSAND:
+        if (!source->grouping) return source->bang_line;
+        return source->group_left == directive->group->count ? source->group_line : source->group_start;
+    default:
+        return source->bang_line;
+    }
+}
+
+void canal_matcher_free(Canal_Matcher *matcher) {
+    scan_lines_free(&matcher->lines);
+    nob_da_free(matcher->source.ends);
+    matcher->source.ends = (Regex_Ends) {0};
+}
+
+void canal_matcher_feed(Arena *arena, Canal_Matcher *matcher, String_View output, bool eof, Canal_Result *result) {
+    if (matcher->status != CANAL_MATCH_PENDING) return;
+
+    Source *source = &matcher->source;
+    source->data = output.data;
+    source->count = output.count;
+    source->lines = &matcher->lines;
+    source->eof = eof;
+
+    while (matcher->status == CANAL_MATCH_PENDING) {
+        if (matcher->directive >= matcher->directives->count) {
+            if (source->bang_count > 0) {
+                if (canal_check_bangs(arena, source, SIZE_MAX, result) == CANAL_STEP_FAILED) {
+                    matcher->status = CANAL_MATCH_FAILED;
+                    break;
+                }
+                if (!eof) break;
+                source->bang_count = 0;
+            }
+            matcher->status = CANAL_MATCH_PASSED;
+            break;
+        }
+
+        Canal_Directive *directive = &matcher->directives->items[matcher->directive];
+        assert(directive->action != CANAL_ACTION_RUN);
+
+        Canal_Action_Func action_func = canal_action_funcs[directive->action];
+        Canal_Step step = action_func(arena, source, directive, result);
+        if (step == CANAL_STEP_MORE) {
+            assert(!eof);
+            if (source->bang_count > 0 && canal_check_bangs(arena, source, canal_source_skipped_end(source, directive), result) == CANAL_STEP_FAILED) {
+                matcher->status = CANAL_MATCH_FAILED;
+            }
+            break;
+        }
+        if (step == CANAL_STEP_FAILED) {
+            matcher->status = CANAL_MATCH_FAILED;
+            break;
+        }
+        // a group closes the range of the `!` before it at the first line it took
+        if (source->bang_count > 0 && directive->action != CANAL_ACTION_BANG) {
+            size_t end = directive->action == CANAL_ACTION_AMPERSAND ? source->group_start : source->dropped + source->next - 1;
+            if (canal_check_bangs(arena, source, end, result) == CANAL_STEP_FAILED) {
+                matcher->status = CANAL_MATCH_FAILED;
+                break;
+            }
+            source->bang_count = 0;
+        }
+        matcher->directive += 1;
+    }
+}
+
+size_t canal_matcher_first_live_line(Canal_Matcher *matcher) {
+    Source *source = &matcher->source;
+    if (source->bang_count > 0 && source->bang_line - source->dropped < source->next) return source->bang_line - source->dropped;
+    return source->next;
+}
+
+size_t canal_matcher_live_offset(Canal_Matcher *matcher, size_t output_count) {
+    if (matcher->status != CANAL_MATCH_PENDING) return output_count;
+
+    Scan_Lines *lines = &matcher->lines;
+    size_t first = canal_matcher_first_live_line(matcher);
+    if (first < lines->count) return lines->items[first].start;
+    return lines->open != SCAN_NO_LINE ? lines->open : lines->scanned;
+}
+
+void canal_matcher_compact(Canal_Matcher *matcher, String *output) {
+    size_t dead = canal_matcher_live_offset(matcher, output->count);
+    if (dead == 0) return;
+
+    memmove(output->items, output->items + dead, output->count - dead);
+    output->count -= dead;
+    if (matcher->status != CANAL_MATCH_PENDING) {
+        canal_matcher_free(matcher);
+        return;
+    }
+
+    Source *source = &matcher->source;
+    size_t first = canal_matcher_first_live_line(matcher);
+    scan_lines_shift(&matcher->lines, first, dead);
+    source->next -= first;
+    source->dropped += first;
+}
+
+typedef enum {
+    CANAL_RUN_EXITED,
+    CANAL_RUN_FAILED,
+    // killed because one of the matchers already failed
+    CANAL_RUN_DECIDED,
+    CANAL_RUN_TIMED_OUT,
+} Canal_Run_Status;
+
+// 128 plus the signal for a child killed by one, -1 if the child could not be waited for
+int canal_proc_wait(Nob_Proc proc) {
+    if (proc == NOB_INVALID_PROC) return -1;
+#ifdef _WIN32
+    if (WaitForSingleObject(proc, INFINITE) == WAIT_FAILED) return -1;
+    DWORD exit_status;
+    bool ok = GetExitCodeProcess(proc, &exit_status);
+    CloseHandle(proc);
+    return ok ? (int) exit_status : -1;
+#else
+    while (true) {
+        int wstatus = 0;
+        if (waitpid(proc, &wstatus, 0) < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (WIFEXITED(wstatus)) return WEXITSTATUS(wstatus);
+        if (WIFSIGNALED(wstatus)) return 128 + WTERMSIG(wstatus);
+    }
+#endif // _WIN32
+}
+
+#ifndef _WIN32
+bool canal_read_available(Arena *arena, Nob_Fd fd, String *str) {
+    str_reserve(arena, str, CANAL_READ_CHUNK);
+    ssize_t n = read(fd, str->items + str->count, str->capacity - str->count);
+    if (n < 0 && (errno == EINTR || errno == EAGAIN)) return true;
+    if (n <= 0) return false;
+    str->count += n;
+    return true;
+}
+
+uint64_t canal_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec*1000 + ts.tv_nsec/1000000;
+}
+
+Nob_Fd canal_pidfd_open(Nob_Proc proc) {
+#ifdef SYS_pidfd_open
+    if (proc == NOB_INVALID_PROC) return NOB_INVALID_FD;
+    int fd = syscall(SYS_pidfd_open, proc, 0);
+    return fd < 0 ? NOB_INVALID_FD : fd;
+#else
+    NOB_UNUSED(proc);
+    return NOB_INVALID_FD;
+#endif
+}
+
+#define CANAL_REACTOR_BATCH 64
+
+typedef struct {
+#ifdef __linux__
+    int epfd;
+#else
+    struct {
+        struct pollfd *items;
+        size_t count;
+        size_t capacity;
+    } pollfds;
+    struct {
+        uint64_t *items;
+        size_t count;
+        size_t capacity;
+    } tokens;
+#endif // __linux__
+} Canal_Reactor;
+
+#ifdef __linux__
+bool canal_reactor_init(Canal_Reactor *reactor) {
+    reactor->epfd = epoll_create1(EPOLL_CLOEXEC);
+    return reactor->epfd >= 0;
+}
+
+void canal_reactor_free(Canal_Reactor *reactor) {
+    close(reactor->epfd);
+}
+
+void canal_reactor_add(Canal_Reactor *reactor, Nob_Fd fd, uint64_t token) {
+    struct epoll_event event = { .events = EPOLLIN, .data.u64 = token };
+    epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, fd, &event);
+}
+
+void canal_reactor_remove(Canal_Reactor *reactor, Nob_Fd fd) {
+    epoll_ctl(reactor->epfd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+int canal_reactor_wait(Canal_Reactor *reactor, uint64_t tokens[CANAL_REACTOR_BATCH], int timeout) {
+    struct epoll_event events[CANAL_REACTOR_BATCH];
+    int ready = epoll_wait(reactor->epfd, events, CANAL_REACTOR_BATCH, timeout);
+    for (int i = 0; i < ready; ++i) {
+        tokens[i] = events[i].data.u64;
+    }
+    return ready;
+}
+#else
+bool canal_reactor_init(Canal_Reactor *reactor) {
+    *reactor = (Canal_Reactor) {0};
+    return true;
+}
+
+void canal_reactor_free(Canal_Reactor *reactor) {
+    nob_da_free(reactor->pollfds);
+    nob_da_free(reactor->tokens);
+}
+
+void canal_reactor_add(Canal_Reactor *reactor, Nob_Fd fd, uint64_t token) {
+    nob_da_append(&reactor->pollfds, ((struct pollfd) { .fd = fd, .events = POLLIN }));
+    nob_da_append(&reactor->tokens, token);
+}
+
+void canal_reactor_remove(Canal_Reactor *reactor, Nob_Fd fd) {
+    for (size_t i = 0; i < reactor->pollfds.count; ++i) {
+        if (reactor->pollfds.items[i].fd != fd) continue;
+        reactor->pollfds.items[i] = reactor->pollfds.items[--reactor->pollfds.count];
+        reactor->tokens.items[i] = reactor->tokens.items[--reactor->tokens.count];
+        return;
+    }
+}
+
+int canal_reactor_wait(Canal_Reactor *reactor, uint64_t tokens[CANAL_REACTOR_BATCH], int timeout) {
+    int ready = poll(reactor->pollfds.items, reactor->pollfds.count, timeout);
+    if (ready <= 0) return ready;
+
+    int count = 0;
+    for (size_t i = 0; i < reactor->pollfds.count && count < CANAL_REACTOR_BATCH; ++i) {
+        if (reactor->pollfds.items[i].revents != 0) tokens[count++] = reactor->tokens.items[i];
+    }
+    return count;
+}
+#endif // __linux__
+
+typedef enum {
+    CANAL_JOB_STDOUT,
+    CANAL_JOB_STDERR,
+    CANAL_JOB_PIDFD,
+    CANAL_JOB_FD_COUNT,
+} Canal_Job_Fd;
+
+typedef struct {
+    Nob_Proc proc;
+    // its own process group, so everything the child spawned dies together with it
+    bool own_group;
+    Nob_Fd fds[CANAL_JOB_FD_COUNT];
+    Nob_Fd memfd_out;
+    Nob_Fd memfd_err;
+    Canal_Reactor *reactor;
+    uint64_t token;
+    String *outputs[CANAL_STREAM_COUNT];
+    Canal_Matcher *matchers[CANAL_STREAM_COUNT];
+    Canal_Result *results[CANAL_STREAM_COUNT];
+    bool kill_early;
+    size_t window;
+    uint64_t deadline;
+    bool killed;
+    bool timed_out;
+} Canal_Job;
+
+void canal_job_start(Canal_Job *job, Nob_Cmd *cmd, Nob_Cmd_Redirect redirect) {
+    job->own_group = job->kill_early || job->deadline > 0;
+    job->proc = job->own_group
+        ? nob_cmd_run_async_redirect_pgroup(*cmd, redirect)
+        : nob_cmd_run_async_redirect(*cmd, redirect);
+    job->fds[CANAL_JOB_PIDFD] = canal_pidfd_open(job->proc);
+    cmd->count = 0;
+}
+
+void canal_job_watch(Canal_Job *job, Canal_Reactor *reactor, uint64_t token) {
+    job->reactor = reactor;
+    job->token = token;
+    for (size_t i = 0; i < CANAL_JOB_FD_COUNT; ++i) {
+        if (job->fds[i] != NOB_INVALID_FD) canal_reactor_add(reactor, job->fds[i], token + i);
+    }
+}
+
+void canal_job_close_fd(Canal_Job *job, Canal_Job_Fd which) {
+    if (job->fds[which] == NOB_INVALID_FD) return;
+    if (job->reactor != NULL) canal_reactor_remove(job->reactor, job->fds[which]);
+    close(job->fds[which]);
+    job->fds[which] = NOB_INVALID_FD;
+}
+
+void canal_job_close_fds(Canal_Job *job) {
+    for (size_t i = 0; i < CANAL_JOB_FD_COUNT; ++i) {
+        canal_job_close_fd(job, i);
+    }
+}
+
+void canal_job_kill(Canal_Job *job) {
+    if (job->proc != NOB_INVALID_PROC) {
+        kill(job->own_group ? -job->proc : job->proc, SIGKILL);
+    }
+    job->killed = true;
+    canal_job_close_fds(job);
+}
+
+bool canal_job_active(Canal_Job *job) {
+    if (job->killed) return false;
+    for (size_t i = 0; i < CANAL_JOB_FD_COUNT; ++i) {
+        if (job->fds[i] != NOB_INVALID_FD) return true;
+    }
+    return false;
+}
+
+bool canal_job_failed(Canal_Job *job) {
+    for (size_t i = 0; i < CANAL_STREAM_COUNT; ++i) {
+        if (job->matchers[i]->status == CANAL_MATCH_FAILED) return true;
+    }
+    return false;
+}
+
+// both pipes have to be drained at the same time, otherwise a child that fills the one we are not reading blocks
+// forever. The pidfd tells us when the child exited even if it left its pipes open
+void canal_job_handle(Arena *arena, Canal_Job *job, Canal_Job_Fd which) {
+    if (job->fds[which] == NOB_INVALID_FD) return;
+    if (which == CANAL_JOB_PIDFD) {
+        canal_job_close_fd(job, which);
+        return;
+    }
+
+    static_assert(CANAL_STREAM_COUNT == 2, "Number of streams change, update code here!");
+    Canal_Stream stream = which == CANAL_JOB_STDOUT ? CANAL_STREAM_STDOUT : CANAL_STREAM_STDERR;
+    String *output = job->outputs[stream];
+    if (!canal_read_available(arena, job->fds[which], output)) {
+        canal_job_close_fd(job, which);
+        return;
+    }
+
+    Canal_Matcher *matcher = job->matchers[stream];
+    canal_matcher_feed(arena, matcher, sv_from_parts(output->items, output->count), false, job->results[stream]);
+    if (job->kill_early && canal_job_failed(job)) {
+        canal_job_kill(job);
+        return;
+    }
+
+    // only compacting once half of the buffer is dead keeps the memmove amortized. Stderr without directives is kept
+    // whole, it is what gets reported on the wrong exit status
+    if (job->window > 0 && matcher->directives->count > 0 && output->count + CANAL_READ_CHUNK > job->window
+        && canal_matcher_live_offset(matcher, output->count)*2 >= output->count) {
+        canal_matcher_compact(matcher, output);
+    }
+}
+
+bool canal_open_pipe(Nob_Fd pipefd[2]) {
+    if (pipe(pipefd) < 0) return false;
+    fcntl(pipefd[0], F_SETFD, FD_CLOEXEC);
+    fcntl(pipefd[1], F_SETFD, FD_CLOEXEC);
+    return true;
+}
+
+bool canal_job_spawn_piped(Arena *arena, Canal_Job *job, Nob_Cmd *cmd) {
+    Nob_Fd out_pipe[2];
+    Nob_Fd err_pipe[2];
+    if (!canal_open_pipe(out_pipe)) {
+        cmd->count = 0;
+        str_append_fmt(arena, job->outputs[CANAL_STREAM_STDERR], "Could not create pipe: %s\n", strerror(errno));
+        return false;
+    }
+    if (!canal_open_pipe(err_pipe)) {
+        close(out_pipe[0]);
+        close(out_pipe[1]);
+        cmd->count = 0;
+        str_append_fmt(arena, job->outputs[CANAL_STREAM_STDERR], "Could not create pipe: %s\n", strerror(errno));
+        return false;
+    }
+
+    Nob_Cmd_Redirect cmd_redirect = {
+        .fdout = &out_pipe[1],
+        .fderr = &err_pipe[1],
+    };
+
+    canal_job_start(job, cmd, cmd_redirect);
+    close(out_pipe[1]);
+    close(err_pipe[1]);
+
+    if (job->window > 0) {
+        str_ensure_capacity(arena, job->outputs[CANAL_STREAM_STDOUT], job->window);
+    }
+
+    job->fds[CANAL_JOB_STDOUT] = out_pipe[0];
+    job->fds[CANAL_JOB_STDERR] = err_pipe[0];
+    return true;
+}
+
+#ifdef __linux__
+void canal_map_memfd(Arena *arena, Nob_Fd fd, Canal_Output *output) {
+    struct stat statbuf;
+    if (fstat(fd, &statbuf) < 0 || statbuf.st_size <= 0) return;
+
+    void *data = mmap(NULL, statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+        output->data.items = data;
+        output->data.count = statbuf.st_size;
+        output->data.capacity = statbuf.st_size;
+        output->mapped = true;
+        return;
+    }
+
+    if (lseek(fd, 0, SEEK_SET) < 0) return;
+    while (canal_read_available(arena, fd, &output->data)) {}
+}
+
+bool canal_job_spawn_memfd(Arena *arena, Canal_Job *job, Nob_Cmd *cmd) {
+    Nob_Fd fdout = memfd_create("canal-stdout", MFD_CLOEXEC);
+    Nob_Fd fderr = memfd_create("canal-stderr", MFD_CLOEXEC);
+    if (fdout < 0 || fderr < 0) {
+        str_append_fmt(arena, job->outputs[CANAL_STREAM_STDERR], "Could not create memfd: %s\n", strerror(errno));
+        if (fdout >= 0) close(fdout);
+        if (fderr >= 0) close(fderr);
+        cmd->count = 0;
+        return false;
+    }
+
+    Nob_Cmd_Redirect cmd_redirect = {
+        .fdout = &fdout,
+        .fderr = &fderr,
+    };
+
+    canal_job_start(job, cmd, cmd_redirect);
+    job->memfd_out = fdout;
+    job->memfd_err = fderr;
+    return true;
+}
+#endif // __linux__
+
+Canal_Run_Status canal_job_complete(Arena *arena, Canal_Job *job, Canal_Output *output, int *exit_status) {
+    canal_job_close_fds(job);
+    *exit_status = canal_proc_wait(job->proc);
+
+#ifdef __linux__
+    if (job->memfd_out != NOB_INVALID_FD) {
+        canal_map_memfd(arena, job->memfd_out, output);
+        close(job->memfd_out);
+        job->memfd_out = NOB_INVALID_FD;
+    }
+    if (job->memfd_err != NOB_INVALID_FD) {
+        Canal_Output err_output = {0};
+        canal_map_memfd(arena, job->memfd_err, &err_output);
+        arena_da_append_many(arena, job->outputs[CANAL_STREAM_STDERR], err_output.data.items, err_output.data.count);
+        canal_output_release(&err_output);
+        close(job->memfd_err);
+        job->memfd_err = NOB_INVALID_FD;
+    }
+#else
+    NOB_UNUSED(arena);
+    NOB_UNUSED(output);
+#endif // __linux__
+
+    if (job->timed_out) return CANAL_RUN_TIMED_OUT;
+    if (job->killed) return CANAL_RUN_DECIDED;
+    return *exit_status >= 0 ? CANAL_RUN_EXITED : CANAL_RUN_FAILED;
+}
+#else
+Canal_Run_Status canal_run_command(Arena *arena, Nob_Cmd *cmd, Canal_Output *output, String *err, int *exit_status) {
+    Canal_Run_Status result = CANAL_RUN_EXITED;
+    const char *temp_out_filepath = "temp.out";
+    const char *temp_err_filepath = "temp.err";
+
+    Nob_Fd fdout = nob_fd_open_for_write(temp_out_filepath);
+    assert(fdout != NOB_INVALID_FD);
+
+    Nob_Fd fderr = nob_fd_open_for_write(temp_err_filepath);
+    assert(fderr != NOB_INVALID_FD);
+
+    Nob_Cmd_Redirect cmd_redirect = {
+        .fdout = &fdout,
+        .fderr = &fderr,
+    };
+
+    Nob_Proc proc = nob_cmd_run_async_redirect_and_reset(cmd, cmd_redirect);
+    *exit_status = canal_proc_wait(proc);
+    if (*exit_status < 0) result = CANAL_RUN_FAILED;
+    canal_read_entire_file(arena, err, temp_err_filepath);
+    canal_read_entire_file(arena, &output->data, temp_out_filepath);
+
+    nob_delete_file(temp_out_filepath);
+    nob_delete_file(temp_err_filepath);
+    return result;
+}
+#endif // _WIN32
+
+typedef struct {
+    const char **argv;
+    size_t argc;
+    uint64_t timeout_ms;
+    int expected_status;
+    size_t result;
+    uint64_t key;
+    bool cacheable;
+    Canal_Output output;
+    String err;
+    int exit_status;
+    Canal_Matcher matchers[CANAL_STREAM_COUNT];
+    Canal_Result err_result;
+#ifndef _WIN32
+    Canal_Job job;
+#endif
+} Canal_Run;
+
+typedef struct {
+    Canal_Run *items;
+    size_t count;
+    size_t capacity;
+} Canal_Runs;
+
+bool canal_find_run(Canal_Runs *runs, Nob_Cmd cmd, uint64_t timeout_ms, int expected_status, size_t *result) {
+    for (size_t i = 0; i < runs->count; ++i) {
+        Canal_Run *run = &runs->items[i];
+        if (run->argc != cmd.count || run->timeout_ms != timeout_ms || run->expected_status != expected_status) continue;
+
+        size_t j = 0;
+        while (j < cmd.count && strcmp(run->argv[j], cmd.items[j]) == 0) j += 1;
+        if (j == cmd.count) {
+            *result = run->result;
+            return true;
+        }
+    }
+    return false;
+}
+
+Canal_Capture canal_run_capture(Canal_Options *options, size_t largest_output) {
+    if (options->capture != CANAL_CAPTURE_AUTO) return options->capture;
+#ifdef __linux__
+    // a memfd holds the whole output until the command exits, which defeats the window
+    bool large = options->window == 0 && largest_output >= CANAL_MEMFD_THRESHOLD;
+    return large ? CANAL_CAPTURE_MEMFD : CANAL_CAPTURE_PIPE;
+#else
+    NOB_UNUSED(largest_output);
+    return CANAL_CAPTURE_PIPE;
+#endif
+}
+
+void canal_run_release(Canal_Run *run) {
+    for (size_t i = 0; i < CANAL_STREAM_COUNT; ++i) {
+        canal_matcher_free(&run->matchers[i]);
+    }
+    canal_output_release(&run->output);
+}
+
+void canal_run_finish(Arena *arena, Canal_Run *run, Canal_Run_Status status, Canal_Options *options, Canal_Result *result, size_t *largest_output) {
+    // only complete outputs can be cached, and a window drops whatever was matched already
+    if (run->cacheable && options->window == 0 && status == CANAL_RUN_EXITED) {
+        cache_store(arena, options->cache_dir, run->key, run->exit_status, &run->output.data, &run->err);
+    }
+
+    Canal_Matcher *err_matcher = &run->matchers[CANAL_STREAM_STDERR];
+    if (status == CANAL_RUN_FAILED || status == CANAL_RUN_TIMED_OUT
+        || (status == CANAL_RUN_EXITED && run->exit_status != run->expected_status)) {
+        result->err = true;
+        result->error_message = (String) {0};
+        if (status == CANAL_RUN_TIMED_OUT) {
+            str_append_fmt(arena, &result->error_message, "Timed out after %gs\n", run->timeout_ms/1000.0);
+        } else if (status == CANAL_RUN_EXITED) {
+            str_append_fmt(arena, &result->error_message, "Exited with status %d, expected %d\n", run->exit_status, run->expected_status);
+            if (err_matcher->directives->count == 0) str_append_sv(arena, &result->error_message, sv_from_parts(run->err.items, run->err.count));
+        } else {
+            result->error_message = run->err;
+            if (result->error_message.count <= 0) {
+                str_append_fmt(arena, &result->error_message, "<command failed with no message>\n");
+            }
+        }
+        canal_run_release(run);
+        return;
+    }
+    if (run->output.data.count > *largest_output) *largest_output = run->output.data.count;
+
+    // a stream that was still pending when the command got killed was cut off, only the others count
+    if (status != CANAL_RUN_DECIDED) {
+        canal_matcher_feed(arena, &run->matchers[CANAL_STREAM_STDOUT], sv_from_parts(run->output.data.items, run->output.data.count), true, result);
+        canal_matcher_feed(arena, err_matcher, sv_from_parts(run->err.items, run->err.count), true, &run->err_result);
+    }
+    if (run->err_result.err) {
+        result->err = true;
+        str_append_fmt(arena, &result->error_message, "%s: "STR_FMT, canal_stream_names[CANAL_STREAM_STDERR], STR_ARG(&run->err_result.error_message));
+    }
+    canal_run_release(run);
+}
+
+bool canal_run_from_cache(Arena *arena, Canal_Run *run, Canal_Options *options, Canal_Result *result, size_t *largest_output) {
+    Cache_Entry entry = {0};
+    if (!run->cacheable || !cache_load(arena, options->cache_dir, run->key, &entry)) return false;
+
+    run->cacheable = false;
+    run->output.data = entry.out;
+    run->err = entry.err;
+    run->exit_status = entry.exit_status;
+    canal_run_finish(arena, run, CANAL_RUN_EXITED, options, result, largest_output);
+    return true;
+}
+
+#ifndef _WIN32
+bool canal_run_spawn(Arena *arena, Canal_Run *run, Canal_Options *options, Canal_Capture capture, Canal_Result *result) {
+    Canal_Job *job = &run->job;
+    *job = (Canal_Job) {
+        .proc = NOB_INVALID_PROC,
+        .fds = { NOB_INVALID_FD, NOB_INVALID_FD, NOB_INVALID_FD },
+        .memfd_out = NOB_INVALID_FD,
+        .memfd_err = NOB_INVALID_FD,
+        .outputs = { &run->output.data, &run->err },
+        .matchers = { &run->matchers[CANAL_STREAM_STDOUT], &run->matchers[CANAL_STREAM_STDERR] },
+        .results = { result, &run->err_result },
+        .kill_early = options->kill_early,
+        .window = options->window,
+    };
+    if (run->timeout_ms > 0) {
+        job->deadline = canal_now_ms() + run->timeout_ms;
+    }
+
+    Nob_Cmd cmd = { .items = run->argv, .count = run->argc, .capacity = run->argc };
+
+    static_assert(CANAL_CAPTURE_COUNT == 3, "Number of capture backends change, update code here!");
+    switch (capture) {
+    case CANAL_CAPTURE_PIPE:
+        return canal_job_spawn_piped(arena, job, &cmd);
+#ifdef __linux__
+    case CANAL_CAPTURE_MEMFD:
+        return canal_job_spawn_memfd(arena, job, &cmd);
+#endif // __linux__
+    default:
+        NOB_UNREACHABLE("canal_run_spawn");
+    }
+}
+
+void canal_run_commands(Arena *arena, Canal_Runs *runs, Canal_Results *results, Canal_Options *options) {
+    size_t jobs = options->command_jobs > 0 ? options->command_jobs : 1;
+    Canal_Run **running = arena_alloc(arena, jobs*sizeof(*running));
+    size_t running_count = 0;
+    size_t next = 0;
+    size_t largest_output = 0;
+
+    Canal_Reactor reactor = {0};
+    bool reactor_ok = canal_reactor_init(&reactor);
+    Errno reactor_err = errno;
+
+    while (next < runs->count || running_count > 0) {
+        while (running_count < jobs && next < runs->count) {
+            Canal_Run *run = &runs->items[next++];
+            Canal_Result *result = &results->items[run->result];
+            if (canal_run_from_cache(arena, run, options, result, &largest_output)) continue;
+
+            if (!reactor_ok) {
+                str_append_fmt(arena, &run->err, "Could not wait for commands: %s\n", strerror(reactor_err));
+                canal_run_finish(arena, run, CANAL_RUN_FAILED, options, result, &largest_output);
+                continue;
+            }
+
+            Canal_Capture capture = canal_run_capture(options, largest_output);
+            if (!canal_run_spawn(arena, run, options, capture, result)) {
+                canal_run_finish(arena, run, CANAL_RUN_FAILED, options, result, &largest_output);
+                continue;
+            }
+            canal_job_watch(&run->job, &reactor, (uint64_t) (run - runs->items)*CANAL_JOB_FD_COUNT);
+            running[running_count++] = run;
+        }
+        if (running_count == 0) continue;
+
+        uint64_t now = canal_now_ms();
+        int timeout = -1;
+        for (size_t i = 0; i < running_count; ++i) {
+            Canal_Job *job = &running[i]->job;
+            if (job->deadline > 0) {
+                uint64_t left = now >= job->deadline ? 0 : job->deadline - now;
+                if (left > INT_MAX) left = INT_MAX;
+                if (timeout < 0 || (int) left < timeout) timeout = (int) left;
+            }
+        }
+
+        uint64_t tokens[CANAL_REACTOR_BATCH];
+        int ready = canal_reactor_wait(&reactor, tokens, timeout);
+        if (ready < 0 && errno == EINTR) continue;
+
+        if (ready < 0) {
+            for (size_t i = 0; i < running_count; ++i) {
+                canal_job_close_fds(&running[i]->job);
+            }
+        }
+        for (int i = 0; i < ready; ++i) {
+            Canal_Run *run = &runs->items[tokens[i]/CANAL_JOB_FD_COUNT];
+            canal_job_handle(arena, &run->job, tokens[i]%CANAL_JOB_FD_COUNT);
+        }
+
+        now = canal_now_ms();
+        // backwards, so removing a finished command only moves an already visited one
+        for (size_t i = running_count; i-- > 0;) {
+            Canal_Run *run = running[i];
+            Canal_Job *job = &run->job;
+            if (canal_job_active(job) && job->deadline > 0 && now >= job->deadline) {
+                job->timed_out = true;
+                canal_job_kill(job);
+            }
+            if (canal_job_active(job)) continue;
+
+            Canal_Run_Status status = canal_job_complete(arena, job, &run->output, &run->exit_status);
+            canal_run_finish(arena, run, status, options, &results->items[run->result], &largest_output);
+            running[i] = running[--running_count];
+        }
+    }
+
+    if (reactor_ok) canal_reactor_free(&reactor);
+}
+#else
+void canal_run_commands(Arena *arena, Canal_Runs *runs, Canal_Results *results, Canal_Options *options) {
+    size_t largest_output = 0;
+    for (size_t i = 0; i < runs->count; ++i) {
+        Canal_Run *run = &runs->items[i];
+        Canal_Result *result = &results->items[run->result];
+        if (canal_run_from_cache(arena, run, options, result, &largest_output)) continue;
+
+        Nob_Cmd cmd = { .items = run->argv, .count = run->argc, .capacity = run->argc };
+        Canal_Run_Status status = canal_run_command(arena, &cmd, &run->output, &run->err, &run->exit_status);
+        canal_run_finish(arena, run, status, options, result, &largest_output);
+    }
+}
+#endif // _WIN32
+
+Canal_Results canal_check(Arena *arena, Nob_Cmd *cmd, Canal_Check *check, const char *filepath, Canal_Options *options) {
+    Canal_Results results = {0};
+    Canal_Runs runs = {0};
+    size_t *sources = arena_alloc(arena, check->r_directives.count*sizeof(*sources));
+
+    for (size_t i = 0; i < check->r_directives.count; ++i) {
+        Canal_Directive *r_directive = &check->r_directives.items[i];
+        assert(r_directive->action == CANAL_ACTION_RUN);
+
+        arena_da_append(arena, &results, (Canal_Result) {0});
+        Canal_Result *result = &results.items[results.count - 1];
+
+        String_View args = r_directive->arguments;
+        while (args.count > 0) {
+            args = sv_trim_left(args);
+            String_View arg_fmt = sv_chop_by_predicate(&args, not_isspace);
+            if (arg_fmt.count == 0) break;
+
+            // TODO(nic): implement proper formatting
+            String arg = {0};
+            if (sv_eq(arg_fmt, sv_from_cstr("%s"))) {
+                str_append_cstr(arena, &arg, filepath);
+                str_append_null(arena, &arg);
+            } else {
+                str_append_sv(arena, &arg, arg_fmt);
+                str_append_null(arena, &arg);
+            }
+            nob_cmd_append(cmd, arg.items);
+        }
+        // NOTE(nic): Nob_String_Builder and String are the same thing
+        nob_cmd_render(*cmd, (Nob_String_Builder*)&result->final_command);
+
+        uint64_t timeout_ms = r_directive->timeout_ms > 0 ? r_directive->timeout_ms : options->timeout_ms;
+
+        // every R directive is matched against the same directives, so the same command gives the same result
+        sources[i] = i;
+        if (canal_find_run(&runs, *cmd, timeout_ms, r_directive->exit_status, &sources[i])) {
+            cmd->count = 0;
+            continue;
+        }
+
+        Canal_Run run = {
+            .argv = arena_memdup(arena, cmd->items, cmd->count*sizeof(*cmd->items)),
+            .argc = cmd->count,
+            .timeout_ms = timeout_ms,
+            .expected_status = r_directive->exit_status,
+            .result = i,
+            .matchers = {
+                canal_matcher_new(arena, check, CANAL_STREAM_STDOUT),
+                canal_matcher_new(arena, check, CANAL_STREAM_STDERR),
+            },
+        };
+        run.cacheable = options->cache_dir != NULL && cache_key(run.argv, run.argc, check->source_hash, &run.key);
+        arena_da_append(arena, &runs, run);
+        cmd->count = 0;
+    }
+
+    canal_run_commands(arena, &runs, &results, options);
+
+    for (size_t i = 0; i < results.count; ++i) {
+        if (sources[i] != i) results.items[i] = results.items[sources[i]];
+    }
+
+    return results;
+}
+
+// returns false only when the file itself could not be read, failed checks are counted in `failed`
+bool canal_check_file(Arena *arena, const char *filepath, Index_Entry *entry, Canal_Options *options, FILE *out, FILE *err, size_t *failed) {
+    Canal_Output file = {0};
+
+    Errno read_err = canal_load_file(arena, &file, filepath);
+    if (read_err) {
+        fprintf(err, "Error: could not read file '%s': %s\n", filepath, strerror(read_err));
+        return false;
+    }
+
+    String_View source = sv_from_parts(file.data.items, file.data.count);
+    Canal_Check check = {0};
+    String compile_error = {0};
+    bool collected = true;
+    if (entry == NULL || !canal_check_from_index(arena, &check, entry, source)) {
+        collected = canal_collect_directives(arena, &check, source, &compile_error);
+        if (options->cache_dir != NULL) {
+            check.source_hash = str_hash(STR_HASH_SEED, file.data.items, file.data.count);
+        }
+    }
+    if (!collected || !canal_compile_directives(arena, &check, &compile_error)) {
+        *failed += 1;
+        fprintf(err, "Error: %s: "STR_FMT, filepath, STR_ARG(&compile_error));
+        canal_check_free_regexes(&check);
+        canal_output_release(&file);
+        return true;
+    }
+
+    Nob_Cmd cmd = {0};
+    Canal_Results results = canal_check(arena, &cmd, &check, filepath, options);
+    nob_cmd_free(cmd);
+
+    for (size_t i = 0; i < results.count; ++i) {
+        Canal_Result *result = &results.items[i];
+        fprintf(out, "[Check %zu] ("STR_FMT"):\n", i + 1, STR_ARG(&result->final_command));
+
+        if (result->err) {
+            *failed += 1;
+            fflush(out);
+            fprintf(err, STR_FMT, STR_ARG(&result->error_message));
         } else {
-            printf("Passed!\n");
+            fprintf(out, "Passed!\n");
         }
 
         if (i < results.count - 1) {
-            printf("\n");
+            fprintf(out, "\n");
+        }
+    }
+
+    canal_check_free_regexes(&check);
+    canal_output_release(&file);
+    return true;
+}
+
+typedef struct {
+    const char *filepath;
+    Index_Entry *entry;
+    Nob_Proc worker;
+    Nob_Fd report_fd;
+    String report;
+    bool done;
+    bool passed;
+} Canal_Suite_File;
+
+typedef struct {
+    Canal_Suite_File *items;
+    size_t count;
+    size_t capacity;
+} Canal_Suite;
+
+bool canal_collect_suite_files(Arena *arena, Canal_Suite *suite, const char *dirpath) {
+    bool result = true;
+
+    size_t temp_checkpoint = nob_temp_save();
+    Nob_File_Paths children = {0};
+    if (!nob_read_entire_dir(dirpath, &children)) return_defer(false);
+
+    String_View dir = sv_from_cstr(dirpath);
+    const char *separator = sv_end_with(dir, "/") ? "" : "/";
+
+    for (size_t i = 0; i < children.count; ++i) {
+        const char *child = children.items[i];
+        if (child[0] == '.') continue;
+
+        const char *path = arena_sprintf(arena, "%s%s%s", dirpath, separator, child);
+        Nob_File_Type type = nob_get_file_type(path);
+        if (type == NOB_FILE_DIRECTORY) {
+            if (!canal_collect_suite_files(arena, suite, path)) return_defer(false);
+        } else if (type == NOB_FILE_REGULAR) {
+            arena_da_append(arena, suite, ((Canal_Suite_File) { .filepath = path, .report_fd = NOB_INVALID_FD }));
+        }
+    }
+
+defer:
+    nob_da_free(children);
+    nob_temp_rewind(temp_checkpoint);
+    return result;
+}
+
+int canal_compare_suite_files(const void *a, const void *b) {
+    return strcmp(((const Canal_Suite_File*)a)->filepath, ((const Canal_Suite_File*)b)->filepath);
+}
+
+bool canal_suite_file_is_test(Canal_Suite_File *file) {
+    if (file->entry == NULL) return true;
+    for (size_t i = 0; i < file->entry->directive_count; ++i) {
+        if (file->entry->directives[i].action == CANAL_ACTION_RUN) return true;
+    }
+    return false;
+}
+
+void canal_plan_suite(Arena *arena, Canal_Suite *suite, Canal_Options *options) {
+    if (options->cache_dir == NULL) return;
+
+    const char *index_path = arena_sprintf(arena, "%s/.index", options->cache_dir);
+    Index index = {0};
+    index_load(arena, index_path, &index);
+
+    Index next_index = {0};
+    bool changed = false;
+    for (size_t i = 0; i < suite->count; ++i) {
+        Canal_Suite_File *file = &suite->items[i];
+
+        Index_Stamp stamp;
+        if (!index_stamp(file->filepath, &stamp)) continue;
+
+        Index_Entry *entry = index_find(&index, file->filepath);
+        if (entry != NULL && index_stamp_eq(&entry->stamp, &stamp)) {
+            arena_da_append(arena, &next_index, *entry);
+            continue;
+        }
+
+        Canal_Output source = {0};
+        if (canal_load_file(arena, &source, file->filepath) != 0) continue;
+
+        String_View data = sv_from_parts(source.data.items, source.data.count);
+        // the worker parses a file with an invalid directive again and reports it
+        Canal_Check check = {0};
+        String collect_error = {0};
+        if (!canal_collect_directives(arena, &check, data, &collect_error)) {
+            canal_output_release(&source);
+            continue;
+        }
+
+        Index_Entry parsed = {
+            .path = file->filepath,
+            .stamp = stamp,
+            .hash = str_hash(STR_HASH_SEED, source.data.items, source.data.count),
+        };
+        canal_check_to_index(arena, &check, data, &parsed);
+        canal_output_release(&source);
+
+        // the file changed between the stamp and the read, it gets parsed again next time
+        if (parsed.stamp.size != data.count) continue;
+
+        arena_da_append(arena, &next_index, parsed);
+        changed = true;
+    }
+
+    // the suite is sorted by path already, which is the order the index has to be in
+    size_t next = 0;
+    for (size_t i = 0; i < suite->count && next < next_index.count; ++i) {
+        if (strcmp(suite->items[i].filepath, next_index.items[next].path) == 0) {
+            suite->items[i].entry = &next_index.items[next++];
+        }
+    }
+
+    if ((changed || next_index.count != index.count) && nob_mkdir_if_not_exists(options->cache_dir)) {
+        index_save(arena, index_path, &next_index);
+    }
+}
+
+size_t canal_default_jobs(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (size_t) count : 1;
+#endif
+}
+
+#ifndef _WIN32
+// the reports go through a pipe so the parent prints them in order no matter when the workers finish
+Nob_Proc canal_spawn_suite_worker(Canal_Suite_File *file, Canal_Options *options) {
+    Nob_Fd pipefd[2];
+    if (!canal_open_pipe(pipefd)) return NOB_INVALID_PROC;
+
+    fflush(stdout);
+    fflush(stderr);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(pipefd[0]);
+        close(pipefd[1]);
+        return NOB_INVALID_PROC;
+    }
+
+    if (pid == 0) {
+        close(pipefd[0]);
+        FILE *report = fdopen(pipefd[1], "w");
+        if (report == NULL) _exit(1);
+
+        Arena arena = {0};
+        size_t failed = 0;
+        bool ok = canal_check_file(&arena, file->filepath, file->entry, options, report, report, &failed);
+        fclose(report);
+        _exit(ok && failed == 0 ? 0 : 1);
+    }
+
+    close(pipefd[1]);
+    file->report_fd = pipefd[0];
+    return pid;
+}
+
+bool canal_drain_suite_worker(Arena *arena, Canal_Reactor *reactor, Canal_Suite_File *file) {
+    char buffer[4096];
+    ssize_t n = read(file->report_fd, buffer, sizeof(buffer));
+    if (n < 0 && errno == EINTR) return false;
+    if (n > 0) {
+        arena_da_append_many(arena, &file->report, buffer, (size_t) n);
+        return false;
+    }
+
+    canal_reactor_remove(reactor, file->report_fd);
+    close(file->report_fd);
+    file->report_fd = NOB_INVALID_FD;
+
+    int wstatus = 0;
+    while (waitpid(file->worker, &wstatus, 0) < 0 && errno == EINTR) {}
+    file->passed = n == 0 && WIFEXITED(wstatus) && WEXITSTATUS(wstatus) == 0;
+    file->done = true;
+    return true;
+}
+#endif // _WIN32
+
+void canal_print_suite_file(Canal_Suite_File *file, size_t *total, size_t *passed) {
+    // files without any R directive produce no report and are not tests
+    if (file->report.count == 0) return;
+
+    if (*total > 0) printf("\n");
+    printf("[File] %s\n", file->filepath);
+    fwrite(file->report.items, sizeof(char), file->report.count, stdout);
+
+    *total += 1;
+    if (file->passed) *passed += 1;
+}
+
+int canal_run_suite(const char *dirpath, size_t jobs, Canal_Options *options) {
+    Arena arena = {0};
+    Canal_Suite suite = {0};
+
+    if (!canal_collect_suite_files(&arena, &suite, dirpath)) {
+        fprintf(stderr, "Error: could not read directory '%s'\n", dirpath);
+        exit(1);
+    }
+    qsort(suite.items, suite.count, sizeof(*suite.items), canal_compare_suite_files);
+    canal_plan_suite(&arena, &suite, options);
+
+    size_t test_count = 0;
+    for (size_t i = 0; i < suite.count; ++i) {
+        Canal_Suite_File *file = &suite.items[i];
+        if (canal_suite_file_is_test(file)) {
+            test_count += 1;
+        } else {
+            file->done = true;
+        }
+    }
+
+    options->command_jobs = test_count > 0 && jobs > test_count ? jobs/test_count : 1;
+
+    size_t total = 0;
+    size_t passed = 0;
+
+#ifdef _WIN32
+    NOB_UNUSED(jobs);
+    for (size_t i = 0; i < suite.count; ++i) {
+        Canal_Suite_File *file = &suite.items[i];
+        if (file->done) continue;
+        Arena file_arena = {0};
+        size_t failed = 0;
+        if (total > 0) printf("\n");
+        printf("[File] %s\n", file->filepath);
+        bool ok = canal_check_file(&file_arena, file->filepath, file->entry, options, stdout, stderr, &failed);
+        arena_free(&file_arena);
+
+        total += 1;
+        if (ok && failed == 0) passed += 1;
+    }
+#else
+    Canal_Reactor reactor = {0};
+    if (!canal_reactor_init(&reactor)) {
+        fprintf(stderr, "Error: could not wait for suite workers: %s\n", strerror(errno));
+        exit(1);
+    }
+    size_t running_count = 0;
+    size_t next = 0;
+    size_t printed = 0;
+
+    while (printed < suite.count) {
+        while (running_count < jobs && next < suite.count) {
+            Canal_Suite_File *file = &suite.items[next++];
+            if (file->done) continue;
+            file->worker = canal_spawn_suite_worker(file, options);
+            if (file->worker == NOB_INVALID_PROC) {
+                str_append_fmt(&arena, &file->report, "Error: could not start worker: %s\n", strerror(errno));
+                file->done = true;
+                continue;
+            }
+            canal_reactor_add(&reactor, file->report_fd, file - suite.items);
+            running_count += 1;
+        }
+
+        if (running_count > 0) {
+            uint64_t tokens[CANAL_REACTOR_BATCH];
+            int ready = canal_reactor_wait(&reactor, tokens, -1);
+            if (ready < 0) {
+                if (errno == EINTR) continue;
+                fprintf(stderr, "Error: could not wait for suite workers: %s\n", strerror(errno));
+                exit(1);
+            }
+
+            for (int i = 0; i < ready; ++i) {
+                if (canal_drain_suite_worker(&arena, &reactor, &suite.items[tokens[i]])) {
+                    running_count -= 1;
+                }
+            }
+        }
+
+        while (printed < suite.count && suite.items[printed].done) {
+            canal_print_suite_file(&suite.items[printed++], &total, &passed);
+        }
+    }
+    canal_reactor_free(&reactor);
+#endif // _WIN32
+
+    printf("\n[Summary] %zu/%zu files passed\n", passed, total);
+
+    arena_free(&arena);
+    return passed == total ? 0 : 1;
+}
+
+bool canal_parse_size(const char *str, size_t *size) {
+    char *end = NULL;
+    unsigned long long value = strtoull(str, &end, 10);
+    if (end == str) return false;
+
+    switch (*end) {
+    case 'K': value *= 1024; end += 1; break;
+    case 'M': value *= 1024*1024; end += 1; break;
+    case 'G': value *= 1024*1024*1024; end += 1; break;
+    default: break;
+    }
+    if (*end != '\0') return false;
+
+    *size = value;
+    return true;
+}
+
+const char *canal_flag_value(const char *flag, const char *arg, int *argc, const char ***argv) {
+    size_t flag_count = strlen(flag);
+    if (strncmp(arg, flag, flag_count) != 0) return NULL;
+    if (arg[flag_count] == '=') return arg + flag_count + 1;
+    if (arg[flag_count] != '\0') return NULL;
+
+    if (*argc <= 0) {
+        fprintf(stderr, "Error: expected value after '%s'\n", flag);
+        exit(1);
+    }
+    return shift(*argv, *argc);
+}
+
+void canal_usage(const char *program_name) {
+    fprintf(stderr, "Usage: %s [-j N] [--capture auto|pipe|memfd] [--kill-early] [--window SIZE] [--timeout DURATION]\n", program_name);
+    fprintf(stderr, "       %*s [--no-cache] [--cache-dir DIR] [--cache-size SIZE] <file|directory>\n", (int) strlen(program_name), "");
+#ifdef _WIN32
+    fprintf(stderr, "On Windows the commands and files run one at a time, without timeouts and without the output cache\n");
+#endif
+}
+
+int main(int argc, const char **argv) {
+    nob_minimal_log_level = NOB_NO_LOGS;
+
+    const char *program_name = shift(argv, argc);
+    const char *filepath = NULL;
+    size_t jobs = 0;
+    Canal_Options options = {
+        .cache_dir = CANAL_DEFAULT_CACHE_DIR,
+        .cache_limit = CANAL_DEFAULT_CACHE_LIMIT,
+    };
+
+    while (argc > 0) {
+        const char *arg = shift(argv, argc);
+        const char *value = NULL;
+        if (strcmp(arg, "--kill-early") == 0) {
+            options.kill_early = true;
+        } else if (strcmp(arg, "--no-cache") == 0) {
+            options.cache_dir = NULL;
+        } else if ((value = canal_flag_value("--cache-dir", arg, &argc, &argv)) != NULL) {
+            options.cache_dir = value;
+        } else if ((value = canal_flag_value("--cache-size", arg, &argc, &argv)) != NULL) {
+            if (!canal_parse_size(value, &options.cache_limit)) {
+                fprintf(stderr, "Error: invalid cache size '%s'\n", value);
+                exit(1);
+            }
+        } else if ((value = canal_flag_value("--window", arg, &argc, &argv)) != NULL) {
+            if (!canal_parse_size(value, &options.window) || options.window < 2*CANAL_READ_CHUNK) {
+                fprintf(stderr, "Error: invalid window '%s', expected a size of at least %dK\n", value, 2*CANAL_READ_CHUNK/1024);
+                exit(1);
+            }
+        } else if ((value = canal_flag_value("--timeout", arg, &argc, &argv)) != NULL) {
+            if (!canal_parse_duration(sv_from_cstr(value), &options.timeout_ms)) {
+                fprintf(stderr, "Error: invalid timeout '%s'\n", value);
+                exit(1);
+            }
+        } else if ((value = canal_flag_value("--capture", arg, &argc, &argv)) != NULL) {
+            size_t i = 0;
+            while (i < CANAL_CAPTURE_COUNT && strcmp(value, canal_capture_names[i]) != 0) i += 1;
+            if (i == CANAL_CAPTURE_COUNT) {
+                fprintf(stderr, "Error: unknown capture backend '%s'\n", value);
+                exit(1);
+            }
+#ifndef __linux__
+            if (i == CANAL_CAPTURE_MEMFD) {
+                fprintf(stderr, "Error: memfd capture is only supported on Linux\n");
+                exit(1);
+            }
+#endif
+            options.capture = i;
+        } else if (strncmp(arg, "-j", 2) == 0) {
+            const char *count = arg + 2;
+            if (*count == '\0') {
+                if (argc <= 0) {
+                    fprintf(stderr, "Error: expected job count after '-j'\n");
+                    exit(1);
+                }
+                count = shift(argv, argc);
+            }
+            char *end = NULL;
+            jobs = strtoul(count, &end, 10);
+            if (*count == '\0' || *end != '\0' || jobs == 0) {
+                fprintf(stderr, "Error: invalid job count '%s'\n", count);
+                exit(1);
+            }
+        } else if (arg[0] == '-') {
+            canal_usage(program_name);
+            fprintf(stderr, "Error: unknown option '%s'\n", arg);
+            exit(1);
+        } else if (filepath != NULL) {
+            canal_usage(program_name);
+            fprintf(stderr, "Error: unexpected argument '%s', only one file or directory can be checked\n", arg);
+            exit(1);
+        } else {
+            filepath = arg;
         }
     }
 
+    if (filepath == NULL) {
+        canal_usage(program_name);
+        fprintf(stderr, "Error: expected filepath\n");
+        exit(1);
+    }
+
+    if (jobs == 0) jobs = canal_default_jobs();
+    if (nob_get_file_type(filepath) == NOB_FILE_DIRECTORY) {
+        int status = canal_run_suite(filepath, jobs, &options);
+        if (options.cache_dir != NULL) cache_evict(options.cache_dir, options.cache_limit);
+        return status;
+    }
+
+    options.command_jobs = jobs;
+    Arena arena = {0};
+    size_t failed = 0;
+    if (!canal_check_file(&arena, filepath, NULL, &options, stdout, stderr, &failed)) {
+        exit(1);
+    }
+    if (options.cache_dir != NULL) cache_evict(options.cache_dir, options.cache_limit);
+
     arena_free(&arena);
     return 0;
 }
@@ -204,6 +204,7 @@
 #    include <sys/stat.h>
 #    include <unistd.h>
 #    include <fcntl.h>
+#    include <spawn.h>
 #endif
 
 #ifdef _WIN32
@@ -456,6 +457,10 @@ Nob_Proc nob_cmd_run_async_and_reset(Nob_Cmd *cmd);
 Nob_Proc nob_cmd_run_async_redirect(Nob_Cmd cmd, Nob_Cmd_Redirect redirect);
 // Run redirected command asynchronously and set cmd.count to 0 and close all the opened files
 Nob_Proc nob_cmd_run_async_redirect_and_reset(Nob_Cmd *cmd, Nob_Cmd_Redirect redirect);
+// Run redirected command asynchronously in a new process group whose id is the pid of the child, so
+// the child and everything it spawned can be signalled at once with kill(-proc, sig). On Windows this
+// is the same as nob_cmd_run_async_redirect()
+Nob_Proc nob_cmd_run_async_redirect_pgroup(Nob_Cmd cmd, Nob_Cmd_Redirect redirect);
 
 // Run command synchronously
 bool nob_cmd_run_sync(Nob_Cmd cmd);
@@ -885,7 +890,11 @@ void nob_cmd_render(Nob_Cmd cmd, Nob_String_Builder *render)
     }
 }
 
-Nob_Proc nob_cmd_run_async_redirect(Nob_Cmd cmd, Nob_Cmd_Redirect redirect)
+#ifndef _WIN32
+extern char **environ;
+#endif // _WIN32
+
+static Nob_Proc nob__cmd_run_async_redirect(Nob_Cmd cmd, Nob_Cmd_Redirect redirect, bool new_pgroup)
 {
     if (cmd.count < 1) {
         nob_log(NOB_ERROR, "Could not run empty command");
@@ -900,6 +909,8 @@ Nob_Proc nob_cmd_run_async_redirect(Nob_Cmd cmd, Nob_Cmd_Redirect redirect)
     memset(&sb, 0, sizeof(sb));
 
 #ifdef _WIN32
+    NOB_UNUSED(new_pgroup);
+
     // https://docs.microsoft.com/en-us/windows/win32/procthread/creating-a-child-process-with-redirected-input-and-output
 
     STARTUPINFO siStartInfo;
@@ -937,56 +948,82 @@ Nob_Proc nob_cmd_run_async_redirect(Nob_Cmd cmd, Nob_Cmd_Redirect redirect)
 
     return piProcInfo.hProcess;
 #else
-    pid_t cpid = fork();
-    if (cpid < 0) {
-        nob_log(NOB_ERROR, "Could not fork child process: %s", strerror(errno));
+    // NOTE: posix_spawn does not copy the page tables of the parent like fork does (glibc and musl
+    // implement it with CLONE_VM|CLONE_VFORK, macOS has a dedicated syscall) so the cost of starting
+    // a child does not grow with the amount of memory the parent holds.
+    posix_spawn_file_actions_t actions;
+    int err = posix_spawn_file_actions_init(&actions);
+    if (err != 0) {
+        nob_log(NOB_ERROR, "Could not initialize spawn file actions: %s", strerror(err));
         return NOB_INVALID_PROC;
     }
 
-    if (cpid == 0) {
-        if (redirect.fdin) {
-            if (dup2(*redirect.fdin, STDIN_FILENO) < 0) {
-                nob_log(NOB_ERROR, "Could not setup stdin for child process: %s", strerror(errno));
-                exit(1);
-            }
-        }
+    if (redirect.fdin && err == 0) {
+        err = posix_spawn_file_actions_adddup2(&actions, *redirect.fdin, STDIN_FILENO);
+        if (err != 0) nob_log(NOB_ERROR, "Could not setup stdin for child process: %s", strerror(err));
+    }
 
-        if (redirect.fdout) {
-            if (dup2(*redirect.fdout, STDOUT_FILENO) < 0) {
-                nob_log(NOB_ERROR, "Could not setup stdout for child process: %s", strerror(errno));
-                exit(1);
-            }
-        }
+    if (redirect.fdout && err == 0) {
+        err = posix_spawn_file_actions_adddup2(&actions, *redirect.fdout, STDOUT_FILENO);
+        if (err != 0) nob_log(NOB_ERROR, "Could not setup stdout for child process: %s", strerror(err));
+    }
 
-        if (redirect.fderr) {
-            if (dup2(*redirect.fderr, STDERR_FILENO) < 0) {
-                nob_log(NOB_ERROR, "Could not setup stderr for child process: %s", strerror(errno));
-                exit(1);
-            }
-        }
+    if (redirect.fderr && err == 0) {
+        err = posix_spawn_file_actions_adddup2(&actions, *redirect.fderr, STDERR_FILENO);
+        if (err != 0) nob_log(NOB_ERROR, "Could not setup stderr for child process: %s", strerror(err));
+    }
 
-        // NOTE: This leaks a bit of memory in the child process.
-        // But do we actually care? It's a one off leak anyway...
-        Nob_Cmd cmd_null = {0};
-        nob_da_append_many(&cmd_null, cmd.items, cmd.count);
-        nob_cmd_append(&cmd_null, NULL);
-
-        if (execvp(cmd.items[0], (char * const*) cmd_null.items) < 0) {
-            const char *msg = strerror(errno);
-            if (redirect.fderr) {
-                write(*redirect.fderr, msg, strlen(msg));
-                write(*redirect.fderr, "\n", sizeof(char));
-            }
-            nob_log(NOB_ERROR, "Could not exec child process: %s", msg);
-            exit(1);
+    if (err != 0) {
+        posix_spawn_file_actions_destroy(&actions);
+        return NOB_INVALID_PROC;
+    }
+
+    posix_spawnattr_t attr;
+    err = posix_spawnattr_init(&attr);
+    if (err == 0 && new_pgroup) {
+        err = posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+        if (err == 0) err = posix_spawnattr_setpgroup(&attr, 0);
+    }
+    if (err != 0) {
+        nob_log(NOB_ERROR, "Could not initialize spawn attributes: %s", strerror(err));
+        posix_spawn_file_actions_destroy(&actions);
+        return NOB_INVALID_PROC;
+    }
+
+    Nob_Cmd cmd_null = {0};
+    nob_da_append_many(&cmd_null, cmd.items, cmd.count);
+    nob_cmd_append(&cmd_null, NULL);
+
+    pid_t cpid;
+    err = posix_spawnp(&cpid, cmd.items[0], &actions, &attr, (char * const*) cmd_null.items, environ);
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    nob_cmd_free(cmd_null);
+
+    if (err != 0) {
+        const char *msg = strerror(err);
+        if (redirect.fderr) {
+            write(*redirect.fderr, msg, strlen(msg));
+            write(*redirect.fderr, "\n", sizeof(char));
         }
-        NOB_UNREACHABLE("nob_cmd_run_async_redirect");
+        nob_log(NOB_ERROR, "Could not exec child process: %s", msg);
+        return NOB_INVALID_PROC;
     }
 
     return cpid;
 #endif
 }
 
+Nob_Proc nob_cmd_run_async_redirect(Nob_Cmd cmd, Nob_Cmd_Redirect redirect)
+{
+    return nob__cmd_run_async_redirect(cmd, redirect, false);
+}
+
+Nob_Proc nob_cmd_run_async_redirect_pgroup(Nob_Cmd cmd, Nob_Cmd_Redirect redirect)
+{
+    return nob__cmd_run_async_redirect(cmd, redirect, true);
+}
+
 Nob_Proc nob_cmd_run_async_and_reset(Nob_Cmd *cmd)
 {
     Nob_Proc proc = nob_cmd_run_async(*cmd);
@@ -1989,6 +2026,7 @@ int closedir(DIR *dirp)
         #define cmd_run_async_and_reset nob_cmd_run_async_and_reset
         #define cmd_run_async_redirect nob_cmd_run_async_redirect
         #define cmd_run_async_redirect_and_reset nob_cmd_run_async_redirect_and_reset
+        #define cmd_run_async_redirect_pgroup nob_cmd_run_async_redirect_pgroup
         #define cmd_run_sync nob_cmd_run_sync
         #define cmd_run_sync_and_reset nob_cmd_run_sync_and_reset
         #define cmd_run_sync_redirect nob_cmd_run_sync_redirect
@@ -0,0 +1,433 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./regex.h"
+
+#define NOB_STRIP_PREFIX
+#include "./nob.h"
+
+// once the DFA has this many states it is built up again from scratch, which bounds its memory
+#define REGEX_MAX_STATES 1024
+
+typedef enum {
+    REGEX_BYTES,
+    REGEX_SPLIT,
+    REGEX_EMPTY,
+    REGEX_MATCH,
+} Regex_Op;
+
+typedef struct {
+    Regex_Op op;
+    int out;
+    int out1;
+    uint8_t set[32];
+} Regex_Node;
+
+typedef struct {
+    int *nodes;
+    size_t count;
+    uint64_t hash;
+    bool accepting;
+    int next[256];
+} Regex_State;
+
+struct Regex {
+    struct {
+        Regex_Node *items;
+        size_t count;
+        size_t capacity;
+    } nodes;
+    int start;
+    struct {
+        Regex_State *items;
+        size_t count;
+        size_t capacity;
+    } states;
+    struct {
+        int *items;
+        size_t count;
+        size_t capacity;
+    } stack, closure;
+    uint32_t *marks;
+    uint32_t generation;
+};
+
+typedef struct {
+    int start;
+    int end;
+} Regex_Frag;
+
+typedef struct {
+    Regex *regex;
+    const char *data;
+    size_t count;
+    size_t pos;
+    const char *error;
+} Regex_Parser;
+
+static int regex_node(Regex *regex, Regex_Op op, int out, int out1) {
+    Regex_Node node = { .op = op, .out = out, .out1 = out1 };
+    nob_da_append(&regex->nodes, node);
+    return (int) regex->nodes.count - 1;
+}
+
+static void regex_set_add(uint8_t set[32], uint8_t ch) {
+    set[ch/8] |= 1 << (ch%8);
+}
+
+static bool regex_set_has(const uint8_t set[32], uint8_t ch) {
+    return (set[ch/8] >> (ch%8)) & 1;
+}
+
+static void regex_set_add_class(uint8_t set[32], char escape) {
+    for (int ch = 0; ch < 256; ++ch) {
+        bool in = false;
+        switch (escape) {
+        case 'd': case 'D': in = ch >= '0' && ch <= '9'; break;
+        case 'w': case 'W': in = (ch >= '0' && ch <= '9') || (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '_'; break;
+        case 's': case 'S': in = ch == ' ' || (ch >= '\t' && ch <= '\r'); break;
+        default: NOB_UNREACHABLE("regex_set_add_class");
+        }
+        if (escape >= 'A' && escape <= 'Z') in = !in;
+        if (in) regex_set_add(set, ch);
+    }
+}
+
+static bool regex_escaped_byte(char escape, uint8_t *ch) {
+    switch (escape) {
+    case 'd': case 'D': case 'w': case 'W': case 's': case 'S': return false;
+    case 'n': *ch = '\n'; return true;
+    case 't': *ch = '\t'; return true;
+    default: *ch = escape; return true;
+    }
+}
+
+static Regex_Frag regex_bytes(Regex *regex, const uint8_t set[32]) {
+    int end = regex_node(regex, REGEX_EMPTY, -1, -1);
+    int start = regex_node(regex, REGEX_BYTES, end, -1);
+    memcpy(regex->nodes.items[start].set, set, 32);
+    return (Regex_Frag) { start, end };
+}
+
+static Regex_Frag regex_parse_alternation(Regex_Parser *parser);
+
+static Regex_Frag regex_parse_class(Regex_Parser *parser) {
+    uint8_t set[32] = {0};
+    bool negate = false;
+    if (parser->pos < parser->count && parser->data[parser->pos] == '^') {
+        negate = true;
+        parser->pos += 1;
+    }
+
+    bool first = true;
+    while (parser->pos < parser->count && (first || parser->data[parser->pos] != ']')) {
+        first = false;
+        uint8_t lo = parser->data[parser->pos++];
+        if (lo == '\\') {
+            if (parser->pos >= parser->count) break;
+            char escape = parser->data[parser->pos++];
+            if (!regex_escaped_byte(escape, &lo)) {
+                regex_set_add_class(set, escape);
+                continue;
+            }
+        }
+
+        uint8_t hi = lo;
+        if (parser->pos + 1 < parser->count && parser->data[parser->pos] == '-' && parser->data[parser->pos + 1] != ']') {
+            hi = parser->data[parser->pos + 1];
+            parser->pos += 2;
+            if (hi == '\\') {
+                if (parser->pos >= parser->count || !regex_escaped_byte(parser->data[parser->pos], &hi)) {
+                    parser->error = "invalid range in character class";
+                    return (Regex_Frag) {0};
+                }
+                parser->pos += 1;
+            }
+            if (hi < lo) {
+                parser->error = "invalid range in character class";
+                return (Regex_Frag) {0};
+            }
+        }
+        for (int ch = lo; ch <= hi; ++ch) regex_set_add(set, ch);
+    }
+
+    if (parser->pos >= parser->count) {
+        parser->error = "unterminated character class";
+        return (Regex_Frag) {0};
+    }
+    parser->pos += 1;
+
+    if (negate) {
+        for (size_t i = 0; i < 32; ++i) set[i] = ~set[i];
+    }
+    return regex_bytes(parser->regex, set);
+}
+
+static Regex_Frag regex_parse_atom(Regex_Parser *parser) {
+    Regex *regex = parser->regex;
+    char ch = parser->data[parser->pos++];
+    uint8_t set[32] = {0};
+
+    switch (ch) {
+    case '(': {
+        Regex_Frag frag = regex_parse_alternation(parser);
+        if (parser->error != NULL) return frag;
+        if (parser->pos >= parser->count || parser->data[parser->pos] != ')') {
+            parser->error = "missing ')'";
+            return frag;
+        }
+        parser->pos += 1;
+        return frag;
+    }
+    case '[':
+        return regex_parse_class(parser);
+    case '.':
+        memset(set, 0xFF, sizeof(set));
+        return regex_bytes(regex, set);
+    case '\\': {
+        if (parser->pos >= parser->count) {
+            parser->error = "trailing '\\'";
+            return (Regex_Frag) {0};
+        }
+        char escape = parser->data[parser->pos++];
+        uint8_t byte;
+        if (regex_escaped_byte(escape, &byte)) {
+            regex_set_add(set, byte);
+        } else {
+            regex_set_add_class(set, escape);
+        }
+        return regex_bytes(regex, set);
+    }
+    case '*': case '+': case '?':
+        parser->error = "nothing to repeat";
+        return (Regex_Frag) {0};
+    case '^': case '$':
+        parser->error = "anchors are not supported, a pattern always matches the whole word";
+        return (Regex_Frag) {0};
+    default:
+        regex_set_add(set, ch);
+        return regex_bytes(regex, set);
+    }
+}
+
+static Regex_Frag regex_parse_repeat(Regex_Parser *parser) {
+    Regex *regex = parser->regex;
+    Regex_Frag frag = regex_parse_atom(parser);
+    while (parser->error == NULL && parser->pos < parser->count) {
+        char op = parser->data[parser->pos];
+        if (op != '*' && op != '+' && op != '?') break;
+        parser->pos += 1;
+
+        int end = regex_node(regex, REGEX_EMPTY, -1, -1);
+        int split = regex_node(regex, REGEX_SPLIT, frag.start, end);
+        if (op == '?') {
+            regex->nodes.items[frag.end].out = end;
+        } else {
+            regex->nodes.items[frag.end].out = split;
+        }
+        frag = (Regex_Frag) { op == '+' ? frag.start : split, end };
+    }
+    return frag;
+}
+
+static Regex_Frag regex_parse_concatenation(Regex_Parser *parser) {
+    Regex *regex = parser->regex;
+    int empty = regex_node(regex, REGEX_EMPTY, -1, -1);
+    Regex_Frag frag = { empty, empty };
+    while (parser->error == NULL && parser->pos < parser->count) {
+        char ch = parser->data[parser->pos];
+        if (ch == '|' || ch == ')') break;
+
+        Regex_Frag next = regex_parse_repeat(parser);
+        if (parser->error != NULL) break;
+        regex->nodes.items[frag.end].out = next.start;
+        frag.end = next.end;
+    }
+    return frag;
+}
+
+static Regex_Frag regex_parse_alternation(Regex_Parser *parser) {
+    Regex *regex = parser->regex;
+    Regex_Frag frag = regex_parse_concatenation(parser);
+    while (parser->error == NULL && parser->pos < parser->count && parser->data[parser->pos] == '|') {
+        parser->pos += 1;
+        Regex_Frag other = regex_parse_concatenation(parser);
+        if (parser->error != NULL) break;
+
+        int end = regex_node(regex, REGEX_EMPTY, -1, -1);
+        int split = regex_node(regex, REGEX_SPLIT, frag.start, other.start);
+        regex->nodes.items[frag.end].out = end;
+        regex->nodes.items[other.end].out = end;
+        frag = (Regex_Frag) { split, end };
+    }
+    return frag;
+}
+
+static int regex_compare_ints(const void *a, const void *b) {
+    int x = *(const int*) a;
+    int y = *(const int*) b;
+    return (x > y) - (x < y);
+}
+
+static void regex_closure(Regex *regex) {
+    regex->generation += 1;
+    regex->closure.count = 0;
+    while (regex->stack.count > 0) {
+        int id = regex->stack.items[--regex->stack.count];
+        if (id < 0 || regex->marks[id] == regex->generation) continue;
+        regex->marks[id] = regex->generation;
+
+        Regex_Node *node = &regex->nodes.items[id];
+        switch (node->op) {
+        case REGEX_SPLIT:
+            nob_da_append(&regex->stack, node->out1);
+            nob_da_append(&regex->stack, node->out);
+            break;
+        case REGEX_EMPTY:
+            nob_da_append(&regex->stack, node->out);
+            break;
+        case REGEX_BYTES:
+        case REGEX_MATCH:
+            nob_da_append(&regex->closure, id);
+            break;
+        }
+    }
+    qsort(regex->closure.items, regex->closure.count, sizeof(*regex->closure.items), regex_compare_ints);
+}
+
+static void regex_free_states(Regex *regex) {
+    for (size_t i = 0; i < regex->states.count; ++i) {
+        free(regex->states.items[i].nodes);
+    }
+    regex->states.count = 0;
+}
+
+static int regex_state(Regex *regex) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < regex->closure.count; ++i) {
+        hash = (hash ^ (uint64_t) regex->closure.items[i])*0x100000001b3ULL;
+    }
+
+    for (size_t i = 0; i < regex->states.count; ++i) {
+        Regex_State *state = &regex->states.items[i];
+        if (state->hash == hash && state->count == regex->closure.count
+            && memcmp(state->nodes, regex->closure.items, state->count*sizeof(*state->nodes)) == 0) {
+            return (int) i;
+        }
+    }
+
+    Regex_State state = { .count = regex->closure.count, .hash = hash };
+    state.nodes = malloc((state.count > 0 ? state.count : 1)*sizeof(*state.nodes));
+    assert(state.nodes != NULL && "Buy more RAM lol");
+    memcpy(state.nodes, regex->closure.items, state.count*sizeof(*state.nodes));
+    for (size_t i = 0; i < state.count; ++i) {
+        if (regex->nodes.items[state.nodes[i]].op == REGEX_MATCH) state.accepting = true;
+    }
+    memset(state.next, 0xFF, sizeof(state.next));
+    nob_da_append(&regex->states, state);
+    return (int) regex->states.count - 1;
+}
+
+// the start state always ends up as state 0, also after the DFA was thrown away
+static void regex_start(Regex *regex) {
+    nob_da_append(&regex->stack, regex->start);
+    regex_closure(regex);
+    regex_state(regex);
+}
+
+static int regex_step(Regex *regex, int from, uint8_t ch) {
+    Regex_State *state = &regex->states.items[from];
+    for (size_t i = state->count; i-- > 0;) {
+        Regex_Node *node = &regex->nodes.items[state->nodes[i]];
+        if (node->op == REGEX_BYTES && regex_set_has(node->set, ch)) {
+            nob_da_append(&regex->stack, node->out);
+        }
+    }
+    regex_closure(regex);
+
+    if (regex->states.count >= REGEX_MAX_STATES) {
+        regex_free_states(regex);
+        // building the start state again must not lose the set we are about to add
+        nob_da_append(&regex->stack, regex->start);
+        size_t saved = regex->closure.count;
+        int *nodes = malloc((saved > 0 ? saved : 1)*sizeof(*nodes));
+        assert(nodes != NULL && "Buy more RAM lol");
+        memcpy(nodes, regex->closure.items, saved*sizeof(*nodes));
+        regex_closure(regex);
+        regex_state(regex);
+
+        regex->closure.count = 0;
+        for (size_t i = 0; i < saved; ++i) nob_da_append(&regex->closure, nodes[i]);
+        free(nodes);
+        return regex_state(regex);
+    }
+
+    int to = regex_state(regex);
+    regex->states.items[from].next[ch] = to;
+    return to;
+}
+
+Regex *regex_compile(const char *pattern, size_t count, const char **error) {
+    Regex *regex = calloc(1, sizeof(*regex));
+    assert(regex != NULL && "Buy more RAM lol");
+
+    Regex_Parser parser = {
+        .regex = regex,
+        .data = pattern,
+        .count = count,
+    };
+    Regex_Frag frag = regex_parse_alternation(&parser);
+    if (parser.error == NULL && parser.pos < parser.count) {
+        parser.error = "unmatched ')'";
+    }
+    if (parser.error != NULL) {
+        *error = parser.error;
+        regex_free(regex);
+        return NULL;
+    }
+
+    int match = regex_node(regex, REGEX_MATCH, -1, -1);
+    regex->nodes.items[frag.end].out = match;
+    regex->start = frag.start;
+    regex->marks = calloc(regex->nodes.count, sizeof(*regex->marks));
+    assert(regex->marks != NULL && "Buy more RAM lol");
+    regex_start(regex);
+    return regex;
+}
+
+bool regex_match(Regex *regex, const char *data, size_t count) {
+    int state = 0;
+    for (size_t i = 0; i < count; ++i) {
+        uint8_t ch = data[i];
+        int next = regex->states.items[state].next[ch];
+        if (next < 0) next = regex_step(regex, state, ch);
+        state = next;
+        if (regex->states.items[state].count == 0) return false;
+    }
+    return regex->states.items[state].accepting;
+}
+
+void regex_match_prefixes(Regex *regex, const char *data, size_t count, Regex_Ends *ends) {
+    int state = 0;
+    if (regex->states.items[state].accepting) nob_da_append(ends, 0);
+    for (size_t i = 0; i < count; ++i) {
+        uint8_t ch = data[i];
+        int next = regex->states.items[state].next[ch];
+        if (next < 0) next = regex_step(regex, state, ch);
+        state = next;
+        if (regex->states.items[state].count == 0) return;
+        if (regex->states.items[state].accepting) nob_da_append(ends, i + 1);
+    }
+}
+
+void regex_free(Regex *regex) {
+    if (regex == NULL) return;
+    regex_free_states(regex);
+    nob_da_free(regex->states);
+    nob_da_free(regex->nodes);
+    nob_da_free(regex->stack);
+    nob_da_free(regex->closure);
+    free(regex->marks);
+    free(regex);
+}
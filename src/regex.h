@@ -0,0 +1,24 @@
+#ifndef REGEX_H_
+#define REGEX_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// supports literals, `.`, classes like `[^a-z_]`, the escapes `\d \w \s \D \W \S \n \t`, groups, `|`, `*`, `+`
+// and `?`. A pattern always has to match the whole input, so there are no anchors
+typedef struct Regex Regex;
+
+Regex *regex_compile(const char *pattern, size_t count, const char **error);
+bool regex_match(Regex *regex, const char *data, size_t count);
+
+typedef struct {
+    size_t *items;
+    size_t count;
+    size_t capacity;
+} Regex_Ends;
+
+// appends the length of every prefix of `data` the pattern matches to `ends`, shortest first
+void regex_match_prefixes(Regex *regex, const char *data, size_t count, Regex_Ends *ends);
+void regex_free(Regex *regex);
+
+#endif // REGEX_H_
@@ -0,0 +1,400 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./scan.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#    define SCAN_X86
+#    include <immintrin.h>
+#endif
+
+static bool scan_starts_with(const char *data, size_t count, size_t at, const char *prefix, size_t prefix_count) {
+    return count - at >= prefix_count && memcmp(data + at, prefix, prefix_count) == 0;
+}
+
+size_t scan_line_prefix_scalar(const char *data, size_t count, size_t start, const char *prefix, size_t prefix_count) {
+    size_t i = start;
+    while (i < count) {
+        if (scan_starts_with(data, count, i, prefix, prefix_count)) return i;
+        const char *newline = memchr(data + i, '\n', count - i);
+        if (newline == NULL) break;
+        i = newline - data + 1;
+    }
+    return count;
+}
+
+#ifdef SCAN_X86
+static bool scan_line_prefix_candidates(const char *data, size_t count, size_t block, uint64_t newlines, const char *prefix, size_t prefix_count, size_t *result) {
+    while (newlines != 0) {
+        size_t candidate = block + __builtin_ctzll(newlines) + 1;
+        if (candidate < count && data[candidate] == prefix[0] && scan_starts_with(data, count, candidate, prefix, prefix_count)) {
+            *result = candidate;
+            return true;
+        }
+        newlines &= newlines - 1;
+    }
+    return false;
+}
+
+__attribute__((target("sse2")))
+static size_t scan_line_prefix_sse2(const char *data, size_t count, size_t start, const char *prefix, size_t prefix_count) {
+    if (start >= count) return count;
+    if (scan_starts_with(data, count, start, prefix, prefix_count)) return start;
+
+    __m128i newline = _mm_set1_epi8('\n');
+    size_t result = count;
+    size_t i = start;
+    for (; i + 64 <= count; i += 64) {
+        __m128i a = _mm_loadu_si128((const __m128i*) (data + i));
+        __m128i b = _mm_loadu_si128((const __m128i*) (data + i + 16));
+        __m128i c = _mm_loadu_si128((const __m128i*) (data + i + 32));
+        __m128i d = _mm_loadu_si128((const __m128i*) (data + i + 48));
+        uint64_t newlines = (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(a, newline))
+            | (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(b, newline)) << 16
+            | (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(c, newline)) << 32
+            | (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(d, newline)) << 48;
+        if (scan_line_prefix_candidates(data, count, i, newlines, prefix, prefix_count, &result)) return result;
+    }
+    for (; i < count; ++i) {
+        if (data[i] == '\n' && scan_line_prefix_candidates(data, count, i, 1, prefix, prefix_count, &result)) return result;
+    }
+    return count;
+}
+
+__attribute__((target("avx2")))
+static size_t scan_line_prefix_avx2(const char *data, size_t count, size_t start, const char *prefix, size_t prefix_count) {
+    if (start >= count) return count;
+    if (scan_starts_with(data, count, start, prefix, prefix_count)) return start;
+
+    __m256i newline = _mm256_set1_epi8('\n');
+    size_t result = count;
+    size_t i = start;
+    for (; i + 64 <= count; i += 64) {
+        __m256i lo = _mm256_loadu_si256((const __m256i*) (data + i));
+        __m256i hi = _mm256_loadu_si256((const __m256i*) (data + i + 32));
+        uint64_t newlines = (uint64_t) (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, newline))
+            | (uint64_t) (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, newline)) << 32;
+        if (scan_line_prefix_candidates(data, count, i, newlines, prefix, prefix_count, &result)) return result;
+    }
+    for (; i < count; ++i) {
+        if (data[i] == '\n' && scan_line_prefix_candidates(data, count, i, 1, prefix, prefix_count, &result)) return result;
+    }
+    return count;
+}
+#endif // SCAN_X86
+
+static bool scan_is_space(char ch) {
+    return ch == ' ' || (ch >= '\t' && ch <= '\r');
+}
+
+// the memchr of the libc is vectorized already and beats a hand written filter as long as the first byte is rare
+size_t scan_find(const char *data, size_t count, size_t start, const char *needle, size_t needle_count) {
+    if (needle_count == 0) return start < count ? start : count;
+    size_t i = start;
+    while (i < count && count - i >= needle_count) {
+        const char *first = memchr(data + i, needle[0], count - i - needle_count + 1);
+        if (first == NULL) break;
+        i = first - data;
+        if (data[i + needle_count - 1] == needle[needle_count - 1] && memcmp(data + i, needle, needle_count) == 0) return i;
+        i += 1;
+    }
+    return count;
+}
+
+static void scan_lines_reserve(Scan_Lines *lines, size_t extra) {
+    if (lines->count + extra > lines->capacity) {
+        while (lines->count + extra > lines->capacity) {
+            lines->capacity = lines->capacity == 0 ? 256 : lines->capacity*2;
+        }
+        lines->items = realloc(lines->items, lines->capacity*sizeof(*lines->items));
+        assert(lines->items != NULL && "Buy more RAM lol");
+    }
+}
+
+static void scan_lines_push(Scan_Lines *lines, size_t start, size_t end) {
+    scan_lines_reserve(lines, 1);
+    lines->items[lines->count++] = (Scan_Line) { start, end };
+}
+
+static void scan_lines_close(Scan_Lines *lines, size_t end) {
+    if (lines->open != SCAN_NO_LINE) {
+        scan_lines_push(lines, lines->open, end);
+        lines->open = SCAN_NO_LINE;
+    }
+}
+
+static void scan_lines_tail(const char *data, size_t start, size_t count, Scan_Lines *lines) {
+    for (size_t i = start; i < count; ++i) {
+        if (data[i] == '\n') {
+            scan_lines_close(lines, i);
+        } else if (lines->open == SCAN_NO_LINE && !scan_is_space(data[i])) {
+            lines->open = i;
+        }
+    }
+}
+
+void scan_index_lines_scalar(const char *data, size_t count, bool eof, Scan_Lines *lines) {
+    scan_lines_tail(data, lines->scanned, count, lines);
+    lines->scanned = count;
+    if (eof) scan_lines_close(lines, count);
+}
+
+#ifdef SCAN_X86
+__attribute__((target("avx2")))
+static void scan_index_lines_avx2(const char *data, size_t count, bool eof, Scan_Lines *lines) {
+    __m256i newline = _mm256_set1_epi8('\n');
+    __m256i tab = _mm256_set1_epi8('\t');
+    __m256i four = _mm256_set1_epi8(4);
+    __m256i space = _mm256_set1_epi8(' ');
+    size_t i = lines->scanned;
+    for (; i + 64 <= count; i += 64) {
+        __m256i lo = _mm256_loadu_si256((const __m256i*) (data + i));
+        __m256i hi = _mm256_loadu_si256((const __m256i*) (data + i + 32));
+        __m256i lo_shifted = _mm256_sub_epi8(lo, tab);
+        __m256i hi_shifted = _mm256_sub_epi8(hi, tab);
+        __m256i lo_spaces = _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(lo_shifted, four), lo_shifted), _mm256_cmpeq_epi8(lo, space));
+        __m256i hi_spaces = _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(hi_shifted, four), hi_shifted), _mm256_cmpeq_epi8(hi, space));
+        uint64_t words = ~((uint64_t) (uint32_t) _mm256_movemask_epi8(lo_spaces) | (uint64_t) (uint32_t) _mm256_movemask_epi8(hi_spaces) << 32);
+        uint64_t newlines = (uint64_t) (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, newline))
+            | (uint64_t) (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, newline)) << 32;
+
+        if (newlines == 0 && lines->open != SCAN_NO_LINE) {
+            const char *end = memchr(data + i + 64, '\n', count - i - 64);
+            i = (end != NULL ? (size_t) (end - data) : count) - 64;
+            continue;
+        }
+
+        scan_lines_reserve(lines, 64);
+        Scan_Line *items = lines->items;
+        size_t line_count = lines->count;
+        size_t open = lines->open;
+        uint64_t rest = ~0ULL;
+        while (newlines != 0) {
+            uint64_t bit = newlines & -newlines;
+            uint64_t before = rest & (bit - 1);
+            if (open == SCAN_NO_LINE && (words & before) != 0) {
+                open = i + __builtin_ctzll(words & before);
+            }
+            if (open != SCAN_NO_LINE) {
+                items[line_count++] = (Scan_Line) { open, i + __builtin_ctzll(bit) };
+                open = SCAN_NO_LINE;
+            }
+            rest &= ~(before | bit);
+            newlines ^= bit;
+        }
+        if (open == SCAN_NO_LINE && (words & rest) != 0) {
+            open = i + __builtin_ctzll(words & rest);
+        }
+        lines->count = line_count;
+        lines->open = open;
+    }
+    scan_lines_tail(data, i, count, lines);
+    lines->scanned = count;
+    if (eof) scan_lines_close(lines, count);
+}
+#endif // SCAN_X86
+
+typedef void (*Scan_Index_Lines_Func)(const char *data, size_t count, bool eof, Scan_Lines *lines);
+
+void scan_index_lines(const char *data, size_t count, bool eof, Scan_Lines *lines) {
+    static Scan_Index_Lines_Func func = NULL;
+    if (func == NULL) {
+#ifdef SCAN_X86
+        __builtin_cpu_init();
+        func = __builtin_cpu_supports("avx2") ? scan_index_lines_avx2 : scan_index_lines_scalar;
+#else
+        func = scan_index_lines_scalar;
+#endif // SCAN_X86
+    }
+    func(data, count, eof, lines);
+}
+
+void scan_lines_shift(Scan_Lines *lines, size_t first, size_t dead) {
+    memmove(lines->items, lines->items + first, (lines->count - first)*sizeof(*lines->items));
+    lines->count -= first;
+    for (size_t i = 0; i < lines->count; ++i) {
+        lines->items[i].start -= dead;
+        lines->items[i].end -= dead;
+    }
+    lines->scanned -= dead;
+    if (lines->open != SCAN_NO_LINE) lines->open -= dead;
+}
+
+void scan_lines_free(Scan_Lines *lines) {
+    free(lines->items);
+    *lines = (Scan_Lines) { .open = SCAN_NO_LINE };
+}
+
+#define SCAN_WORDS_VECTOR_MIN 64
+
+typedef struct {
+    size_t (*common)(const char *a, const char *b, size_t count);
+    size_t (*skip_space)(const char *data, size_t count, size_t start);
+} Scan_Words_Kernel;
+
+static size_t scan_common_scalar(const char *a, const char *b, size_t count) {
+    size_t i = 0;
+    while (i < count && a[i] == b[i]) i += 1;
+    return i;
+}
+
+static size_t scan_skip_space_scalar(const char *data, size_t count, size_t start) {
+    while (start < count && scan_is_space(data[start])) start += 1;
+    return start;
+}
+
+// `words` are joined by single spaces, so where the line has exactly one space between two words both sides are
+// compared as plain bytes. Only where they differ it has to be figured out whether that is whitespace or a word
+static bool scan_words_match_with(const Scan_Words_Kernel *kernel, const char *line, size_t line_count, const char *words, size_t words_count) {
+    if (line_count == 0 || words_count == 0) return true;
+
+    size_t p = kernel->skip_space(line, line_count, 0);
+    if (p == line_count) return false;
+    size_t q = 0;
+
+    while (true) {
+        size_t count = line_count - p < words_count - q ? line_count - p : words_count - q;
+        size_t common = kernel->common(line + p, words + q, count);
+        p += common;
+        q += common;
+
+        if (q == words_count) {
+            return p == line_count || scan_is_space(line[p]);
+        }
+        if (p == line_count) {
+            // the line ran out of words, which is fine unless it stopped in the middle of one
+            return words[q] == ' ' || words[q - 1] == ' ';
+        }
+
+        if (words[q] == ' ') {
+            // one separator after a word is always consumed, only the rest of the run gets skipped
+            if (!scan_is_space(line[p])) return false;
+            p += 1;
+            if (p == line_count) return true;
+            q += 1;
+        } else if (!(q > 0 && words[q - 1] == ' ' && scan_is_space(line[p]))) {
+            return false;
+        }
+
+        p = kernel->skip_space(line, line_count, p);
+        if (p == line_count) return false;
+    }
+}
+
+static const Scan_Words_Kernel scan_words_scalar = { scan_common_scalar, scan_skip_space_scalar };
+
+#ifdef SCAN_X86
+__attribute__((target("sse2")))
+static __m128i scan_space_mask_sse2(__m128i block) {
+    // '\t' to '\r' are the 5 bytes that are at most 4 after subtracting '\t' when compared unsigned
+    __m128i shifted = _mm_sub_epi8(block, _mm_set1_epi8('\t'));
+    __m128i control = _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8(4)), shifted);
+    return _mm_or_si128(control, _mm_cmpeq_epi8(block, _mm_set1_epi8(' ')));
+}
+
+__attribute__((target("sse2")))
+static size_t scan_common_sse2(const char *a, const char *b, size_t count) {
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i*) (a + i));
+        __m128i y = _mm_loadu_si128((const __m128i*) (b + i));
+        uint32_t differ = ~_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) & 0xFFFF;
+        if (differ != 0) return i + __builtin_ctz(differ);
+    }
+    return i + scan_common_scalar(a + i, b + i, count - i);
+}
+
+__attribute__((target("sse2")))
+static size_t scan_skip_space_sse2(const char *data, size_t count, size_t start) {
+    size_t i = start;
+    for (; i + 16 <= count; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*) (data + i));
+        uint32_t other = ~_mm_movemask_epi8(scan_space_mask_sse2(block)) & 0xFFFF;
+        if (other != 0) return i + __builtin_ctz(other);
+    }
+    return scan_skip_space_scalar(data, count, i);
+}
+
+__attribute__((target("avx2")))
+static __m256i scan_space_mask_avx2(__m256i block) {
+    __m256i shifted = _mm256_sub_epi8(block, _mm256_set1_epi8('\t'));
+    __m256i control = _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, _mm256_set1_epi8(4)), shifted);
+    return _mm256_or_si256(control, _mm256_cmpeq_epi8(block, _mm256_set1_epi8(' ')));
+}
+
+__attribute__((target("avx2")))
+static size_t scan_common_avx2(const char *a, const char *b, size_t count) {
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i x = _mm256_loadu_si256((const __m256i*) (a + i));
+        __m256i y = _mm256_loadu_si256((const __m256i*) (b + i));
+        uint32_t differ = ~(uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y));
+        if (differ != 0) return i + __builtin_ctz(differ);
+    }
+    return i + scan_common_scalar(a + i, b + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static size_t scan_skip_space_avx2(const char *data, size_t count, size_t start) {
+    size_t i = start;
+    for (; i + 32 <= count; i += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i*) (data + i));
+        uint32_t other = ~(uint32_t) _mm256_movemask_epi8(scan_space_mask_avx2(block));
+        if (other != 0) return i + __builtin_ctz(other);
+    }
+    return scan_skip_space_scalar(data, count, i);
+}
+
+static const Scan_Words_Kernel scan_words_sse2 = { scan_common_sse2, scan_skip_space_sse2 };
+static const Scan_Words_Kernel scan_words_avx2 = { scan_common_avx2, scan_skip_space_avx2 };
+#endif // SCAN_X86
+
+bool scan_words_match_scalar(const char *line, size_t line_count, const char *words, size_t words_count) {
+    return scan_words_match_with(&scan_words_scalar, line, line_count, words, words_count);
+}
+
+bool scan_words_match(const char *line, size_t line_count, const char *words, size_t words_count) {
+    static const Scan_Words_Kernel *kernel = NULL;
+    if (kernel == NULL) {
+#ifdef SCAN_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            kernel = &scan_words_avx2;
+        } else if (__builtin_cpu_supports("sse2")) {
+            kernel = &scan_words_sse2;
+        } else {
+            kernel = &scan_words_scalar;
+        }
+#else
+        kernel = &scan_words_scalar;
+#endif // SCAN_X86
+    }
+    if (line_count < SCAN_WORDS_VECTOR_MIN) {
+        return scan_words_match_with(&scan_words_scalar, line, line_count, words, words_count);
+    }
+    return scan_words_match_with(kernel, line, line_count, words, words_count);
+}
+
+typedef size_t (*Scan_Line_Prefix_Func)(const char *data, size_t count, size_t start, const char *prefix, size_t prefix_count);
+
+size_t scan_line_prefix(const char *data, size_t count, size_t start, const char *prefix, size_t prefix_count) {
+    static Scan_Line_Prefix_Func func = NULL;
+    if (func == NULL) {
+#ifdef SCAN_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            func = scan_line_prefix_avx2;
+        } else if (__builtin_cpu_supports("sse2")) {
+            func = scan_line_prefix_sse2;
+        } else {
+            func = scan_line_prefix_scalar;
+        }
+#else
+        func = scan_line_prefix_scalar;
+#endif // SCAN_X86
+    }
+    return func(data, count, start, prefix, prefix_count);
+}
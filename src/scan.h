@@ -0,0 +1,42 @@
+#ifndef SCAN_H_
+#define SCAN_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// returns the offset of the first line at or after the line start `start` that begins with `prefix`, or `count`
+size_t scan_line_prefix(const char *data, size_t count, size_t start, const char *prefix, size_t prefix_count);
+
+size_t scan_line_prefix_scalar(const char *data, size_t count, size_t start, const char *prefix, size_t prefix_count);
+
+size_t scan_find(const char *data, size_t count, size_t start, const char *needle, size_t needle_count);
+
+#define SCAN_NO_LINE SIZE_MAX
+
+// a line goes from its first non-whitespace byte up to the newline after it, lines without a word are left out
+typedef struct {
+    size_t start;
+    size_t end;
+} Scan_Line;
+
+typedef struct {
+    Scan_Line *items;
+    size_t count;
+    size_t capacity;
+    // `open` is where the line still open at `indexed` starts, the lines have to start out with SCAN_NO_LINE there
+    size_t scanned;
+    size_t open;
+} Scan_Lines;
+
+void scan_index_lines(const char *data, size_t count, bool eof, Scan_Lines *lines);
+void scan_index_lines_scalar(const char *data, size_t count, bool eof, Scan_Lines *lines);
+void scan_lines_shift(Scan_Lines *lines, size_t first, size_t dead);
+void scan_lines_free(Scan_Lines *lines);
+
+// `words` are the words of a directive joined by single spaces, it has to agree with canal_line_matches_tokens
+bool scan_words_match(const char *line, size_t line_count, const char *words, size_t words_count);
+
+bool scan_words_match_scalar(const char *line, size_t line_count, const char *words, size_t words_count);
+
+#endif // SCAN_H_
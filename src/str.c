@@ -8,6 +8,18 @@ void str_ensure_capacity(Arena *arena, String *str, size_t cap) {
     str->capacity = cap;
 }
 
+// unlike str_ensure_capacity this grows geometrically, use it when appending in a loop
+void str_reserve(Arena *arena, String *str, size_t extra) {
+    if (str->capacity - str->count >= extra) {
+        return;
+    }
+    size_t cap = str->capacity*2;
+    if (cap < str->count + extra) {
+        cap = str->count + extra;
+    }
+    str_ensure_capacity(arena, str, cap);
+}
+
 bool str_eq(String *a, String *b) {
     if (a->count != b->count) {
         return false;
@@ -39,3 +51,12 @@ void str_append_fmt(Arena *arena, String *str, const char *fmt, ...) {
     str_append_vfmt(arena, str, fmt, args);
     va_end(args);
 }
+
+uint64_t str_hash(uint64_t hash, const void *data, size_t count) {
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < count; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
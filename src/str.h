@@ -6,10 +6,14 @@
 #include <stdbool.h>
 #include <string.h>
 #include <stdarg.h>
+#include <stdint.h>
 
 #include "./arena.h"
 
 #define STR_FMT "%.*s"
+
+// FNV-1a, chain calls to hash several pieces of data together
+#define STR_HASH_SEED 0xcbf29ce484222325ULL
 #define STR_ARG(str) (int) (str)->count, (str)->items
 
 #define str_append_char(a, str, ch) arena_da_append((a), (str), ch)
@@ -24,9 +28,11 @@ typedef struct {
 } String;
 
 void str_ensure_capacity(Arena *arena, String *str, size_t cap);
+void str_reserve(Arena *arena, String *str, size_t extra);
 bool str_eq(String *a, String *b);
 bool str_eq_cstr(String *a, const char *b);
 void str_append_vfmt(Arena *arena, String *str, const char *fmt, va_list args);
 void str_append_fmt(Arena *arena, String *str, const char *fmt, ...);
+uint64_t str_hash(uint64_t hash, const void *data, size_t count);
 
 #endif // STR_H_
@@ -0,0 +1,182 @@
+// Times the vectorized kernels of scan.c against their scalar versions, and the word comparison and the regex engine
+// against the generic matcher, on generated output. `./nob bench` runs it
+#define main canal_main
+#include "../src/main.c"
+#undef main
+
+#define BENCH_OUTPUT_SIZE (64*1024*1024)
+#define BENCH_LINE_REPEATS 200000
+
+uint64_t bench_nanos(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec*1000000000 + ts.tv_nsec;
+}
+
+void bench_report(const char *name, uint64_t nanos, uint64_t baseline) {
+    printf("%-40s %9.2f ms", name, nanos/1e6);
+    if (baseline > 0 && nanos > 0) printf("  %5.2fx", (double) baseline/nanos);
+    printf("\n");
+}
+
+// lines that look like a disassembly, with a directive line every few thousand of them
+void bench_output(String_Builder *output) {
+    const char *mnemonics[] = { "mov", "add", "sub", "lea", "call", "cmp", "jne", "ret" };
+    const char *operands[] = { "%rax,", "%rbx,", "%rcx", "0x10(%rbp),", "$0x1f,", "%rdi" };
+    uint64_t state = 0x2545F4914F6CDD1DULL;
+    size_t line = 0;
+    while (output->count < BENCH_OUTPUT_SIZE) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        if (line++ % 4096 == 0) {
+            nob_sb_append_cstr(output, "// * directive\n");
+            continue;
+        }
+        nob_sb_appendf(output, "  %6zx:\t%s %s %s\n", line*4, mnemonics[state % NOB_ARRAY_LEN(mnemonics)],
+                       operands[(state >> 8) % NOB_ARRAY_LEN(operands)], operands[(state >> 16) % NOB_ARRAY_LEN(operands)]);
+    }
+}
+
+void bench_line_prefix(String_Builder *output) {
+    size_t found = 0;
+    uint64_t start = bench_nanos();
+    for (size_t at = 0; at < output->count; at += 1) {
+        at = scan_line_prefix_scalar(output->items, output->count, at, "//", 2);
+        if (at < output->count) found += 1;
+        while (at < output->count && output->items[at] != '\n') at += 1;
+    }
+    uint64_t scalar = bench_nanos() - start;
+
+    start = bench_nanos();
+    for (size_t at = 0; at < output->count; at += 1) {
+        at = scan_line_prefix(output->items, output->count, at, "//", 2);
+        if (at < output->count) found -= 1;
+        while (at < output->count && output->items[at] != '\n') at += 1;
+    }
+    uint64_t vector = bench_nanos() - start;
+    assert(found == 0);
+
+    bench_report("scan_line_prefix_scalar", scalar, 0);
+    bench_report("scan_line_prefix", vector, scalar);
+}
+
+void bench_index_lines(String_Builder *output) {
+    Scan_Lines lines = { .open = SCAN_NO_LINE };
+    uint64_t start = bench_nanos();
+    scan_index_lines_scalar(output->items, output->count, true, &lines);
+    uint64_t scalar = bench_nanos() - start;
+    size_t count = lines.count;
+    scan_lines_free(&lines);
+
+    start = bench_nanos();
+    scan_index_lines(output->items, output->count, true, &lines);
+    uint64_t vector = bench_nanos() - start;
+    assert(lines.count == count);
+    scan_lines_free(&lines);
+
+    bench_report("scan_index_lines_scalar", scalar, 0);
+    bench_report("scan_index_lines", vector, scalar);
+}
+
+// a long line against the same words, which is the worst case since nothing stops the comparison early
+void bench_words_match(Arena *arena) {
+    String_Builder line = {0};
+    String_Builder source = {0};
+    nob_sb_append_cstr(&source, "// *");
+    for (size_t i = 0; i < 64; ++i) {
+        nob_sb_appendf(&line, "%s0x%04zx,", i > 0 ? (i % 8 == 0 ? "\t" : " ") : "", i);
+        nob_sb_appendf(&source, " 0x%04zx,", i);
+    }
+    nob_sb_append_cstr(&source, "\n");
+
+    Canal_Check check = {0};
+    String error = {0};
+    bool compiled = canal_collect_directives(arena, &check, sv_from_parts(source.items, source.count), &error)
+        && canal_compile_directives(arena, &check, &error);
+    assert(compiled);
+    Canal_Directive *directive = &check.directives[CANAL_STREAM_STDOUT].items[0];
+    String_View words = directive->words;
+    Regex_Ends ends = {0};
+
+    size_t matched = 0;
+    uint64_t start = bench_nanos();
+    for (size_t i = 0; i < BENCH_LINE_REPEATS; ++i) {
+        matched += canal_line_matches_tokens(sv_from_parts(line.items, line.count), directive, NULL, &ends);
+    }
+    uint64_t tokens = bench_nanos() - start;
+
+    start = bench_nanos();
+    for (size_t i = 0; i < BENCH_LINE_REPEATS; ++i) {
+        matched += scan_words_match_scalar(line.items, line.count, words.data, words.count);
+    }
+    uint64_t scalar = bench_nanos() - start;
+
+    start = bench_nanos();
+    for (size_t i = 0; i < BENCH_LINE_REPEATS; ++i) {
+        matched += scan_words_match(line.items, line.count, words.data, words.count);
+    }
+    uint64_t vector = bench_nanos() - start;
+    assert(matched == 3*BENCH_LINE_REPEATS);
+
+    bench_report("canal_line_matches_tokens", tokens, 0);
+    bench_report("scan_words_match_scalar", scalar, tokens);
+    bench_report("scan_words_match", vector, tokens);
+
+    nob_da_free(ends);
+    canal_check_free_regexes(&check);
+    nob_da_free(line);
+    nob_da_free(source);
+}
+
+// the same line against a pattern that matches it, and against a capture that has to try every end of its match
+void bench_regex(Arena *arena) {
+    String_Builder line = {0};
+    nob_da_append(&line, 'x');
+    for (size_t i = 0; i < 40000; ++i) nob_da_append(&line, 'a');
+    nob_da_append(&line, 'b');
+
+    const char *sources[] = {
+        "// * x{{a*}}b\n",
+        "// * x[[V:a*]]b\n",
+    };
+    const char *names[] = {
+        "regex_match",
+        "canal_parts_match",
+    };
+    for (size_t i = 0; i < NOB_ARRAY_LEN(sources); ++i) {
+        Canal_Check check = {0};
+        String error = {0};
+        bool compiled = canal_collect_directives(arena, &check, sv_from_cstr(sources[i]), &error)
+            && canal_compile_directives(arena, &check, &error);
+        assert(compiled);
+        Canal_Directive *directive = &check.directives[CANAL_STREAM_STDOUT].items[0];
+        Regex_Ends ends = {0};
+
+        uint64_t start = bench_nanos();
+        for (size_t j = 0; j < 100; ++j) {
+            bool matched = canal_line_matches_tokens(sv_from_parts(line.items, line.count), directive, NULL, &ends);
+            assert(matched);
+        }
+        bench_report(names[i], bench_nanos() - start, 0);
+
+        nob_da_free(ends);
+        canal_check_free_regexes(&check);
+    }
+    nob_da_free(line);
+}
+
+int main(void) {
+    Arena arena = {0};
+    String_Builder output = {0};
+    bench_output(&output);
+
+    bench_line_prefix(&output);
+    bench_index_lines(&output);
+    bench_words_match(&arena);
+    bench_regex(&arena);
+
+    nob_da_free(output);
+    arena_free(&arena);
+    return 0;
+}
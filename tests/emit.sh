@@ -0,0 +1,11 @@
+# Prints the lines of a check file that start with `#1>` to stdout and the ones that start with `#2>` to stderr, in
+# order, then exits with the status on its `#?` line
+status=0
+while IFS= read -r line; do
+    case "$line" in
+        '#1>'*) printf '%s\n' "${line#???}" ;;
+        '#2>'*) printf '%s\n' "${line#???}" >&2 ;;
+        '#?'*) status="${line#??}" ;;
+    esac
+done < "$1"
+exit "$status"
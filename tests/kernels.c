@@ -0,0 +1,315 @@
+// Checks every vectorized kernel of scan.c against its scalar version and canal_line_matches_tokens, and the regex
+// engine against the POSIX one of the libc, on random inputs. `./nob test` runs it
+#define main canal_main
+#include "../src/main.c"
+#undef main
+
+// included instead of linked, so the kernels the CPU dispatch would not pick can be called as well
+#include "../src/scan.c"
+
+#include <regex.h>
+
+#define TEST_ROUNDS 20000
+
+uint64_t test_state = 0x9e3779b97f4a7c15ULL;
+
+size_t test_below(size_t n) {
+    test_state ^= test_state << 13;
+    test_state ^= test_state >> 7;
+    test_state ^= test_state << 17;
+    return n > 0 ? test_state % n : 0;
+}
+
+void test_fill(char *data, size_t count, const char *alphabet) {
+    size_t alphabet_count = strlen(alphabet);
+    for (size_t i = 0; i < count; ++i) data[i] = alphabet[test_below(alphabet_count)];
+}
+
+typedef struct {
+    const char *name;
+    Scan_Line_Prefix_Func func;
+} Test_Line_Prefix;
+
+void test_line_prefix(size_t *failed) {
+    Test_Line_Prefix funcs[3];
+    size_t func_count = 0;
+    funcs[func_count++] = (Test_Line_Prefix) { "dispatch", scan_line_prefix };
+#ifdef SCAN_X86
+    if (__builtin_cpu_supports("sse2")) funcs[func_count++] = (Test_Line_Prefix) { "sse2", scan_line_prefix_sse2 };
+    if (__builtin_cpu_supports("avx2")) funcs[func_count++] = (Test_Line_Prefix) { "avx2", scan_line_prefix_avx2 };
+#endif // SCAN_X86
+
+    char data[512];
+    char prefix[3];
+    for (size_t round = 0; round < TEST_ROUNDS; ++round) {
+        size_t count = test_below(sizeof(data));
+        test_fill(data, count, "//\n a\t");
+        size_t prefix_count = 1 + test_below(sizeof(prefix));
+        test_fill(prefix, prefix_count, "/a ");
+
+        size_t start = test_below(count + 1);
+        while (start > 0 && data[start - 1] != '\n') start -= 1;
+
+        size_t expected = scan_line_prefix_scalar(data, count, start, prefix, prefix_count);
+        for (size_t i = 0; i < func_count; ++i) {
+            size_t actual = funcs[i].func(data, count, start, prefix, prefix_count);
+            if (actual == expected) continue;
+            fprintf(stderr, "scan_line_prefix (%s): %zu instead of %zu for '%.*s' from %zu in '%.*s'\n",
+                    funcs[i].name, actual, expected, (int) prefix_count, prefix, start, (int) count, data);
+            *failed += 1;
+        }
+    }
+}
+
+typedef struct {
+    const char *name;
+    Scan_Index_Lines_Func func;
+} Test_Index_Lines;
+
+bool test_lines_eq(Scan_Lines *a, Scan_Lines *b) {
+    if (a->count != b->count || a->scanned != b->scanned || a->open != b->open) return false;
+    return a->count == 0 || memcmp(a->items, b->items, a->count*sizeof(*a->items)) == 0;
+}
+
+void test_index_lines(size_t *failed) {
+    Test_Index_Lines funcs[2];
+    size_t func_count = 0;
+    funcs[func_count++] = (Test_Index_Lines) { "dispatch", scan_index_lines };
+#ifdef SCAN_X86
+    if (__builtin_cpu_supports("avx2")) funcs[func_count++] = (Test_Index_Lines) { "avx2", scan_index_lines_avx2 };
+#endif // SCAN_X86
+
+    char data[600];
+    size_t cuts[8];
+    for (size_t round = 0; round < TEST_ROUNDS; ++round) {
+        size_t count = test_below(sizeof(data));
+        test_fill(data, count, "ab  \t\n\n");
+
+        // the output arrives in pieces, the last one sets eof unless the command is still running
+        size_t cut_count = 1 + test_below(NOB_ARRAY_LEN(cuts));
+        for (size_t i = 0; i < cut_count; ++i) cuts[i] = test_below(count + 1);
+        cuts[cut_count - 1] = count;
+        bool eof = test_below(4) != 0;
+
+        Scan_Lines expected = { .open = SCAN_NO_LINE };
+        size_t scanned = 0;
+        for (size_t i = 0; i < cut_count; ++i) {
+            if (cuts[i] < scanned) continue;
+            scanned = cuts[i];
+            scan_index_lines_scalar(data, scanned, eof && i == cut_count - 1, &expected);
+        }
+
+        for (size_t f = 0; f < func_count; ++f) {
+            Scan_Lines actual = { .open = SCAN_NO_LINE };
+            scanned = 0;
+            for (size_t i = 0; i < cut_count; ++i) {
+                if (cuts[i] < scanned) continue;
+                scanned = cuts[i];
+                funcs[f].func(data, scanned, eof && i == cut_count - 1, &actual);
+            }
+            if (!test_lines_eq(&actual, &expected)) {
+                fprintf(stderr, "scan_index_lines (%s): %zu lines instead of %zu in '%.*s'\n",
+                        funcs[f].name, actual.count, expected.count, (int) count, data);
+                *failed += 1;
+            }
+            scan_lines_free(&actual);
+        }
+        scan_lines_free(&expected);
+    }
+}
+
+typedef struct {
+    const char *name;
+    const Scan_Words_Kernel *kernel;
+} Test_Words_Kernel;
+
+const char *test_words[] = { "a", "ab", "b", "mov", "movq", "%rax,", "0x7ffd", "x" };
+
+void test_append_words(String *str, size_t count, bool spaces) {
+    for (size_t i = 0; i < count; ++i) {
+        if (i > 0 || (spaces && test_below(4) == 0)) {
+            size_t run = spaces ? 1 + test_below(3) : 1;
+            for (size_t j = 0; j < run; ++j) {
+                char space = spaces ? " \t\v\f\r"[test_below(5)] : ' ';
+                nob_da_append(str, space);
+            }
+        }
+        const char *word = test_words[test_below(NOB_ARRAY_LEN(test_words))];
+        nob_da_append_many(str, word, strlen(word));
+    }
+}
+
+void test_words_match(size_t *failed) {
+    Test_Words_Kernel kernels[3];
+    size_t kernel_count = 0;
+    kernels[kernel_count++] = (Test_Words_Kernel) { "scalar", &scan_words_scalar };
+#ifdef SCAN_X86
+    if (__builtin_cpu_supports("sse2")) kernels[kernel_count++] = (Test_Words_Kernel) { "sse2", &scan_words_sse2 };
+    if (__builtin_cpu_supports("avx2")) kernels[kernel_count++] = (Test_Words_Kernel) { "avx2", &scan_words_avx2 };
+#endif // SCAN_X86
+
+    Arena arena = {0};
+    String line = {0};
+    String source = {0};
+    for (size_t round = 0; round < TEST_ROUNDS; ++round) {
+        line.count = 0;
+        test_append_words(&line, test_below(40), true);
+
+        // most directives are the start of the line with a byte changed here and there, random ones
+        // almost never match
+        source.count = 0;
+        nob_sb_append_cstr(&source, "// * ");
+        size_t words_start = source.count;
+        if (test_below(3) != 0) {
+            for (size_t i = 0; i < line.count; ++i) {
+                if (!scan_is_space(line.items[i])) {
+                    nob_da_append(&source, line.items[i]);
+                } else if (!scan_is_space(source.items[source.count - 1])) {
+                    nob_da_append(&source, ' ');
+                }
+            }
+            while (source.count > words_start && source.items[source.count - 1] == ' ') source.count -= 1;
+            source.count = words_start + test_below(source.count - words_start + 1);
+            if (source.count > words_start && source.items[source.count - 1] == ' ') source.count -= 1;
+            if (source.count > words_start && test_below(4) == 0) {
+                source.items[words_start + test_below(source.count - words_start)] = "ax%"[test_below(3)];
+            }
+        } else {
+            test_append_words(&source, test_below(6), false);
+        }
+        size_t words_count = source.count - words_start;
+        nob_da_append(&source, '\n');
+
+        Canal_Check check = {0};
+        String error = {0};
+        bool compiled = canal_collect_directives(&arena, &check, sv_from_parts(source.items, source.count), &error)
+            && canal_compile_directives(&arena, &check, &error);
+        assert(compiled);
+        Canal_Directive *directive = &check.directives[CANAL_STREAM_STDOUT].items[0];
+        Regex_Ends ends = {0};
+        bool expected = canal_line_matches_tokens(sv_from_parts(line.items, line.count), directive, NULL, &ends);
+
+        const char *words = source.items + words_start;
+        for (size_t i = 0; i < kernel_count; ++i) {
+            bool actual = scan_words_match_with(kernels[i].kernel, line.items, line.count, words, words_count);
+            if (actual == expected) continue;
+            fprintf(stderr, "scan_words_match (%s): %s instead of %s for '%.*s' against '%.*s'\n", kernels[i].name,
+                    actual ? "true" : "false", expected ? "true" : "false", (int) words_count, words, (int) line.count, line.items);
+            *failed += 1;
+        }
+        if (scan_words_match(line.items, line.count, words, words_count) != expected) {
+            fprintf(stderr, "scan_words_match: disagrees for '%.*s' against '%.*s'\n", (int) words_count, words, (int) line.count, line.items);
+            *failed += 1;
+        }
+        canal_check_free_regexes(&check);
+        arena_reset(&arena);
+    }
+    nob_da_free(line);
+    nob_da_free(source);
+    arena_free(&arena);
+}
+
+void test_append_pattern(String *pattern, size_t depth) {
+    size_t terms = 1 + test_below(depth > 0 ? 3 : 2);
+    for (size_t i = 0; i < terms; ++i) {
+        if (i > 0) nob_da_append(pattern, '|');
+        size_t atoms = 1 + test_below(3);
+        for (size_t j = 0; j < atoms; ++j) {
+            size_t kind = test_below(depth > 0 ? 6 : 5);
+            if (kind == 5) {
+                nob_da_append(pattern, '(');
+                test_append_pattern(pattern, depth - 1);
+                nob_da_append(pattern, ')');
+            } else {
+                const char *atom = (const char*[]) { "a", "b", ".", "[ab]", "[^a]" }[kind];
+                nob_da_append_many(pattern, atom, strlen(atom));
+            }
+            size_t repeat = test_below(6);
+            if (repeat < 3) nob_da_append(pattern, "*+?"[repeat]);
+        }
+    }
+}
+
+bool test_posix_match(regex_t *posix, const char *data, size_t count) {
+    char input[64];
+    assert(count < sizeof(input));
+    memcpy(input, data, count);
+    input[count] = '\0';
+    return regexec(posix, input, 0, NULL, 0) == 0;
+}
+
+void test_regex_pattern(const char *pattern, size_t max_input, size_t inputs, size_t *failed) {
+    const char *error = NULL;
+    Regex *regex = regex_compile(pattern, strlen(pattern), &error);
+    if (regex == NULL) {
+        fprintf(stderr, "regex_compile: '%s' is invalid: %s\n", pattern, error);
+        *failed += 1;
+        return;
+    }
+    regex_t posix;
+    const char *anchored = nob_temp_sprintf("^(%s)$", pattern);
+    if (regcomp(&posix, anchored, REG_EXTENDED | REG_NOSUB) != 0) {
+        fprintf(stderr, "regcomp: '%s' is invalid\n", anchored);
+        *failed += 1;
+        regex_free(regex);
+        return;
+    }
+
+    char input[64];
+    Regex_Ends ends = {0};
+    for (size_t i = 0; i < inputs; ++i) {
+        size_t count = test_below(max_input + 1);
+        test_fill(input, count, "abc");
+
+        bool expected = test_posix_match(&posix, input, count);
+        if (regex_match(regex, input, count) != expected) {
+            fprintf(stderr, "regex_match: '%s' %s '%.*s'\n", pattern, expected ? "has to match" : "must not match", (int) count, input);
+            *failed += 1;
+        }
+
+        ends.count = 0;
+        regex_match_prefixes(regex, input, count, &ends);
+        size_t next = 0;
+        for (size_t end = 0; end <= count; ++end) {
+            bool found = next < ends.count && ends.items[next] == end;
+            if (found) next += 1;
+            if (found == test_posix_match(&posix, input, end)) continue;
+            fprintf(stderr, "regex_match_prefixes: '%s' and the first %zu bytes of '%.*s'\n", pattern, end, (int) count, input);
+            *failed += 1;
+            break;
+        }
+    }
+    nob_da_free(ends);
+    regfree(&posix);
+    regex_free(regex);
+}
+
+void test_regex(size_t *failed) {
+    String pattern = {0};
+    for (size_t round = 0; round < TEST_ROUNDS/20; ++round) {
+        pattern.count = 0;
+        test_append_pattern(&pattern, 2);
+        nob_da_append(&pattern, '\0');
+        size_t temp_checkpoint = nob_temp_save();
+        test_regex_pattern(pattern.items, 10, 20, failed);
+        nob_temp_rewind(temp_checkpoint);
+    }
+    nob_da_free(pattern);
+
+    // needs more DFA states than REGEX_MAX_STATES, so the states get thrown away in the middle of a match
+    test_regex_pattern("(a|b|c)*a(a|b|c)(a|b|c)(a|b|c)(a|b|c)(a|b|c)(a|b|c)(a|b|c)", 60, 2000, failed);
+}
+
+int main(void) {
+    size_t failed = 0;
+    test_line_prefix(&failed);
+    test_index_lines(&failed);
+    test_words_match(&failed);
+    test_regex(&failed);
+    if (failed > 0) {
+        fprintf(stderr, "kernels: %zu checks failed\n", failed);
+        return 1;
+    }
+    printf("kernels: all checks passed\n");
+    return 0;
+}